@@ -0,0 +1,210 @@
+// Measures how long a D-Bus activated portal keeps its first caller waiting.
+//
+// The daemon is not started directly: a private dbus-daemon activates it from
+// a .service file when CreateSession is called, as the session bus does after
+// an idle exit. Each run times that first CreateSession (cold) and a second
+// one on the running daemon (warm), closes both sessions and waits for the
+// daemon to give up its name again after --idle-exit.
+
+#include "mock_compositor.h"
+#include "portal_harness.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+struct Options {
+    int runs = 10;
+    unsigned idle_exit = 1;     // seconds the daemon waits before exiting
+    double max_ms = 0;          // fail if a cold start takes longer; 0 for no bound
+    std::string daemon = PORTAL_BINARY;
+    bool verbose = false;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// Milliseconds the call took, or a negative value if it failed
+static double create_session(sdbus::IProxy& portal, const std::string& session_handle) {
+    auto start = Clock::now();
+    try {
+        uint32_t response = 0;
+        std::map<std::string, sdbus::Variant> results;
+        portal.callMethod("CreateSession")
+            .onInterface(PORTAL_INTERFACE)
+            .withTimeout(std::chrono::seconds(30))
+            .withArguments(sdbus::ObjectPath{"/org/freedesktop/portal/desktop/request/cold_start"},
+                           sdbus::ObjectPath{session_handle}, std::string("cold-start"),
+                           std::map<std::string, sdbus::Variant>{})
+            .storeResultsTo(response, results);
+        if (response != 0) {
+            std::cerr << "CreateSession answered " << response << std::endl;
+            return -1;
+        }
+    } catch (const sdbus::Error& e) {
+        std::cerr << "CreateSession failed: " << e.what() << std::endl;
+        return -1;
+    }
+    return elapsed_ms(start);
+}
+
+static void close_session(sdbus::IConnection& connection, const std::string& session_handle) {
+    auto session = sdbus::createProxy(connection, sdbus::ServiceName{PORTAL_NAME}, sdbus::ObjectPath{session_handle});
+    session->callMethod("Close").onInterface("org.freedesktop.impl.portal.Session");
+}
+
+static bool name_has_owner(sdbus::IProxy& bus) {
+    bool owned = false;
+    bus.callMethod("NameHasOwner")
+        .onInterface("org.freedesktop.DBus")
+        .withArguments(std::string(PORTAL_NAME))
+        .storeResultsTo(owned);
+    return owned;
+}
+
+struct Summary {
+    double min, median, max;
+};
+
+static Summary summarize(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return {values.front(), values[values.size() / 2], values.back()};
+}
+
+static void usage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --runs N         Activations to time (default 10)" << std::endl;
+    std::cout << "  --idle-exit S    --idle-exit passed to the daemon (default 1)" << std::endl;
+    std::cout << "  --max-ms MS      Fail if any cold start takes longer (default: no bound)" << std::endl;
+    std::cout << "  --daemon PATH    Portal binary to activate (default " << PORTAL_BINARY << ")" << std::endl;
+    std::cout << "  --verbose, -v    Show portal and dbus-daemon output" << std::endl;
+    std::cout << "  --help, -h       Show this help message" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--runs" && has_value) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--idle-exit" && has_value) {
+            options.idle_exit = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--max-ms" && has_value) {
+            options.max_ms = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--daemon" && has_value) {
+            options.daemon = argv[++i];
+        } else if (arg == "--verbose" || arg == "-v") {
+            options.verbose = true;
+        } else {
+            usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    MockCompositor compositor;
+    compositor.set_recording(false);
+    if (!compositor.start()) {
+        return 1;
+    }
+    // Activated daemons get the bus's environment, so this must be set first
+    setenv("WAYLAND_DISPLAY", compositor.socket_name().c_str(), 1);
+
+    char dir_template[] = "/tmp/hypr-remote-cold-start-XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        std::cerr << "Failed to create a service directory" << std::endl;
+        compositor.stop();
+        return 1;
+    }
+    std::string service_dir = dir_template;
+    std::string service_path = service_dir + "/" + PORTAL_NAME + ".service";
+    {
+        std::ofstream service(service_path);
+        service << "[D-BUS Service]\n"
+                << "Name=" << PORTAL_NAME << "\n"
+                << "Exec=" << options.daemon << " --idle-exit " << options.idle_exit
+                << (options.verbose ? " --verbose" : "") << "\n";
+    }
+
+    pid_t bus_pid = -1;
+    std::string bus_address = start_private_bus(bus_pid, service_dir);
+    if (bus_address.empty()) {
+        std::cerr << "Failed to start a private dbus-daemon" << std::endl;
+        terminate(bus_pid);
+        compositor.stop();
+        return 1;
+    }
+    setenv("DBUS_SESSION_BUS_ADDRESS", bus_address.c_str(), 1);
+
+    std::vector<double> cold;
+    std::vector<double> warm;
+    int exit_code = 0;
+    try {
+        auto connection = sdbus::createSessionBusConnection();
+        auto portal = sdbus::createProxy(*connection, sdbus::ServiceName{PORTAL_NAME}, sdbus::ObjectPath{PORTAL_PATH});
+        auto bus = sdbus::createProxy(*connection, sdbus::ServiceName{"org.freedesktop.DBus"},
+                                      sdbus::ObjectPath{"/org/freedesktop/DBus"});
+
+        for (int run = 0; run < options.runs && exit_code == 0; run++) {
+            std::string first = "/org/freedesktop/portal/desktop/session/cold_start_" + std::to_string(run);
+            std::string second = first + "_warm";
+
+            double cold_ms = create_session(*portal, first);
+            double warm_ms = cold_ms >= 0 ? create_session(*portal, second) : -1;
+            if (cold_ms < 0 || warm_ms < 0) {
+                exit_code = 1;
+                break;
+            }
+            cold.push_back(cold_ms);
+            warm.push_back(warm_ms);
+            std::printf("run %3d  cold %8.2f ms  warm %6.2f ms\n", run + 1, cold_ms, warm_ms);
+
+            // With both sessions gone the daemon should exit on its own
+            close_session(*connection, first);
+            close_session(*connection, second);
+            auto deadline = Clock::now() + std::chrono::seconds(options.idle_exit + 5);
+            while (name_has_owner(*bus)) {
+                if (Clock::now() > deadline) {
+                    std::cerr << "Portal did not exit after " << options.idle_exit << " s without sessions" << std::endl;
+                    exit_code = 1;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    } catch (const sdbus::Error& e) {
+        std::cerr << "D-Bus error: " << e.what() << std::endl;
+        exit_code = 1;
+    }
+
+    if (!cold.empty()) {
+        Summary c = summarize(cold);
+        Summary w = summarize(warm);
+        std::printf("\n%-6s %10s %10s %10s\n", "", "min ms", "median ms", "max ms");
+        std::printf("%-6s %10.2f %10.2f %10.2f\n", "cold", c.min, c.median, c.max);
+        std::printf("%-6s %10.2f %10.2f %10.2f\n", "warm", w.min, w.median, w.max);
+        if (options.max_ms > 0 && c.max > options.max_ms) {
+            std::cerr << "Cold start took " << c.max << " ms, over the " << options.max_ms << " ms bound" << std::endl;
+            exit_code = 1;
+        }
+    }
+
+    terminate(bus_pid);
+    compositor.stop();
+    unlink((service_dir + "/bus.conf").c_str());
+    unlink(service_path.c_str());
+    rmdir(service_dir.c_str());
+    return exit_code;
+}
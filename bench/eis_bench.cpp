@@ -0,0 +1,337 @@
+// End-to-end EIS benchmark: libei sender -> portal daemon -> Wayland sink.
+//
+// Starts a private dbus-daemon and an in-process mock Wayland compositor,
+// launches the portal against both, obtains an EIS fd through ConnectToEIS and
+// sends a configurable mix of motion, button, scroll and key events. Every
+// event is timestamped when it is sent and again when the request carrying it
+// reaches the compositor, so no real compositor or GPU is needed.
+
+#include "latency_stats.h"
+#include "mock_compositor.h"
+#include "portal_harness.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+#include <libei.h>
+#include <linux/input-event-codes.h>
+}
+
+enum Kind { MOTION, BUTTON, SCROLL, KEY, KIND_COUNT };
+static const char* kind_names[KIND_COUNT] = {"motion", "button", "scroll", "key"};
+
+static uint64_t now_ns() {
+    return LatencyTracker::now_ns();
+}
+
+struct Options {
+    uint64_t events = 100000;
+    double rate = 0;                               // events/s, 0 = as fast as possible
+    unsigned weights[KIND_COUNT] = {85, 5, 5, 5};
+    std::string daemon = PORTAL_BINARY;
+    uint32_t seed = 1;
+    double drain_timeout = 5.0;
+    int64_t request_delay_us = 0;                  // simulated slow compositor
+    bool verbose = false;
+};
+
+// Send times indexed by per-kind sequence number. The sender fills them in
+// before an event goes out; the sink reads them once the event arrives.
+struct Timeline {
+    std::vector<std::atomic<uint64_t>> sent[KIND_COUNT];
+    std::atomic<uint64_t> sent_count[KIND_COUNT] = {};
+    std::atomic<uint64_t> delivered[KIND_COUNT] = {};
+    std::atomic<uint64_t> last_delivery_ns{0};
+    LatencyHistogram latency[KIND_COUNT];
+
+    void reserve(Kind kind, size_t count) {
+        sent[kind] = std::vector<std::atomic<uint64_t>>(count);
+    }
+
+    void mark_sent(Kind kind) {
+        uint64_t index = sent_count[kind].load(std::memory_order_relaxed);
+        sent[kind][index].store(now_ns(), std::memory_order_release);
+        sent_count[kind].store(index + 1, std::memory_order_release);
+    }
+
+    // Everything of this kind up to (but excluding) total has now arrived
+    void mark_delivered(Kind kind, uint64_t total) {
+        uint64_t now = now_ns();
+        uint64_t done = delivered[kind].load(std::memory_order_relaxed);
+        total = std::min<uint64_t>(total, sent_count[kind].load(std::memory_order_acquire));
+        for (; done < total; done++) {
+            uint64_t sent_ns = sent[kind][done].load(std::memory_order_acquire);
+            latency[kind].record(now > sent_ns ? now - sent_ns : 0);
+        }
+        delivered[kind].store(done, std::memory_order_release);
+        last_delivery_ns.store(now, std::memory_order_release);
+    }
+};
+
+// Turns requests arriving at the mock compositor into deliveries
+class Sink {
+public:
+    explicit Sink(Timeline& timeline) : timeline(timeline) {}
+
+    void receive(const MockCompositor::Request& request);
+
+private:
+    Timeline& timeline;
+
+    // Running totals of what has arrived; only touched on the compositor thread
+    double motion_total = 0;
+    int64_t scroll_steps = 0;
+    uint64_t buttons = 0;
+    uint64_t keys = 0;
+};
+
+void Sink::receive(const MockCompositor::Request& request) {
+    using RequestType = MockCompositor::RequestType;
+    switch (request.type) {
+        case RequestType::PointerMotion:
+            // Every motion event moves by exactly one unit, so the running sum
+            // says how many of them have arrived even when the portal coalesces them
+            motion_total += request.values[0];
+            timeline.mark_delivered(MOTION, static_cast<uint64_t>(motion_total + 0.5));
+            break;
+        case RequestType::PointerButton:
+            timeline.mark_delivered(BUTTON, ++buttons);
+            break;
+        case RequestType::PointerAxisDiscrete:
+            // Scroll events are one detent each, counted through the discrete steps
+            scroll_steps += std::abs(static_cast<int32_t>(request.args[1]));
+            timeline.mark_delivered(SCROLL, static_cast<uint64_t>(scroll_steps));
+            break;
+        case RequestType::KeyboardKey:
+            timeline.mark_delivered(KEY, ++keys);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool parse_mix(const std::string& mix, unsigned weights[KIND_COUNT]) {
+    std::stringstream stream(mix);
+    std::string item;
+    unsigned values[KIND_COUNT];
+    int count = 0;
+    while (std::getline(stream, item, ':')) {
+        if (count == KIND_COUNT) return false;
+        values[count++] = static_cast<unsigned>(std::strtoul(item.c_str(), nullptr, 10));
+    }
+    if (count != KIND_COUNT) return false;
+    std::copy(values, values + KIND_COUNT, weights);
+    return true;
+}
+
+static void usage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --events N       Number of events to send (default 100000)" << std::endl;
+    std::cout << "  --rate HZ        Events per second, 0 for as fast as possible (default 0)" << std::endl;
+    std::cout << "  --mix M:B:S:K    Relative weights of motion, button, scroll and key events (default 85:5:5:5)" << std::endl;
+    std::cout << "  --seed N         Seed for the event mix (default 1)" << std::endl;
+    std::cout << "  --compositor-delay US  Time the mock compositor spends on every request (default 0)" << std::endl;
+    std::cout << "  --daemon PATH    Portal binary to benchmark (default " << PORTAL_BINARY << ")" << std::endl;
+    std::cout << "  --verbose, -v    Show portal and dbus-daemon output" << std::endl;
+    std::cout << "  --help, -h       Show this help message" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--events" && has_value) {
+            options.events = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--rate" && has_value) {
+            options.rate = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--mix" && has_value) {
+            if (!parse_mix(argv[++i], options.weights)) {
+                std::cerr << "Invalid --mix, expected four weights like 85:5:5:5" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--seed" && has_value) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--compositor-delay" && has_value) {
+            options.request_delay_us = std::strtoll(argv[++i], nullptr, 10);
+        } else if (arg == "--daemon" && has_value) {
+            options.daemon = argv[++i];
+        } else if (arg == "--verbose" || arg == "-v") {
+            options.verbose = true;
+        } else {
+            usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    // Decide the whole sequence up front so runs with the same seed are comparable
+    std::mt19937 rng(options.seed);
+    std::discrete_distribution<int> pick(options.weights, options.weights + KIND_COUNT);
+    std::vector<Kind> sequence(options.events);
+    size_t per_kind[KIND_COUNT] = {};
+    for (auto& kind : sequence) {
+        kind = static_cast<Kind>(pick(rng));
+        per_kind[kind]++;
+    }
+
+    Timeline timeline;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        // One extra slot for the release that ends a held button or key
+        timeline.reserve(static_cast<Kind>(k), per_kind[k] + 1);
+    }
+
+    pid_t bus_pid = -1;
+    std::string bus_address = start_private_bus(bus_pid);
+    if (bus_address.empty()) {
+        std::cerr << "Failed to start a private dbus-daemon" << std::endl;
+        terminate(bus_pid);
+        return 1;
+    }
+
+    Sink sink(timeline);
+    MockCompositor compositor;
+    compositor.set_recording(false);
+    compositor.set_request_delay(std::chrono::microseconds(options.request_delay_us));
+    compositor.set_request_listener([&sink](const MockCompositor::Request& request) {
+        sink.receive(request);
+    });
+    if (!compositor.start()) {
+        terminate(bus_pid);
+        return 1;
+    }
+
+    setenv("DBUS_SESSION_BUS_ADDRESS", bus_address.c_str(), 1);
+    setenv("WAYLAND_DISPLAY", compositor.socket_name().c_str(), 1);
+    pid_t daemon_pid = spawn({options.daemon}, options.verbose);
+
+    int exit_code = 1;
+    Sender sender;
+    try {
+        auto connection = sdbus::createSessionBusConnection();
+        int eis_fd = connect_to_eis(*connection, 10.0, "/org/freedesktop/portal/desktop/session/eis_bench", "eis-bench");
+        if (eis_fd >= 0 && sender.connect(eis_fd, 5.0, "eis-bench")) {
+            exit_code = 0;
+        }
+    } catch (const sdbus::Error& e) {
+        std::cerr << "D-Bus error: " << e.what() << std::endl;
+    }
+
+    if (exit_code != 0) {
+        sender.cleanup();
+        terminate(daemon_pid);
+        compositor.stop();
+        terminate(bus_pid);
+        return 1;
+    }
+
+    std::cout << "Sending " << options.events << " events ";
+    if (options.rate > 0) {
+        std::cout << "at " << options.rate << " events/s";
+    } else {
+        std::cout << "as fast as possible";
+    }
+    std::cout << " (mix " << options.weights[MOTION] << ":" << options.weights[BUTTON] << ":"
+              << options.weights[SCROLL] << ":" << options.weights[KEY] << ")" << std::endl;
+
+    bool button_down = false;
+    bool key_down = false;
+    auto send = [&](Kind kind) {
+        timeline.mark_sent(kind);
+        struct ei_device* device = kind == KEY ? sender.keyboard : sender.pointer;
+        switch (kind) {
+            case MOTION:
+                ei_device_pointer_motion(device, 1.0, 0.0);
+                break;
+            case BUTTON:
+                button_down = !button_down;
+                ei_device_button_button(device, BTN_LEFT, button_down);
+                break;
+            case SCROLL:
+                ei_device_scroll_discrete(device, 0, 120);
+                break;
+            case KEY:
+                key_down = !key_down;
+                ei_device_keyboard_key(device, KEY_A, key_down);
+                break;
+            default:
+                break;
+        }
+        ei_device_frame(device, ei_now(sender.ei));
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ns = now_ns();
+    for (size_t i = 0; i < sequence.size(); i++) {
+        if (options.rate > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration<double>(i / options.rate));
+        }
+        send(sequence[i]);
+        if (i % 64 == 0 && !sender.pump()) {
+            std::cerr << "Portal disconnected the EIS client" << std::endl;
+            break;
+        }
+    }
+    if (button_down) send(BUTTON);
+    if (key_down) send(KEY);
+    uint64_t send_done_ns = now_ns();
+
+    // Let the tail drain through the portal
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(options.drain_timeout);
+    auto all_delivered = [&timeline]() {
+        for (int k = 0; k < KIND_COUNT; k++) {
+            if (timeline.delivered[k].load() < timeline.sent_count[k].load()) return false;
+        }
+        return true;
+    };
+    while (!all_delivered() && std::chrono::steady_clock::now() < deadline) {
+        sender.pump();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint64_t total_sent = 0;
+    uint64_t total_delivered = 0;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        total_sent += timeline.sent_count[k].load();
+        total_delivered += timeline.delivered[k].load();
+    }
+    double send_seconds = (send_done_ns - start_ns) / 1e9;
+    uint64_t last_delivery_ns = std::max(timeline.last_delivery_ns.load(), start_ns);
+    double delivery_seconds = (last_delivery_ns - start_ns) / 1e9;
+
+    std::printf("\nsent      %10llu events in %.3f s (%.0f events/s)\n",
+                static_cast<unsigned long long>(total_sent), send_seconds, total_sent / send_seconds);
+    std::printf("delivered %10llu events in %.3f s (%.0f events/s)\n\n",
+                static_cast<unsigned long long>(total_delivered), delivery_seconds,
+                delivery_seconds > 0 ? total_delivered / delivery_seconds : 0.0);
+    std::printf("%-8s %10s %10s %10s %10s %10s %10s\n",
+                "kind", "sent", "delivered", "p50 us", "p90 us", "p99 us", "max us");
+    for (int k = 0; k < KIND_COUNT; k++) {
+        const LatencyHistogram& latency = timeline.latency[k];
+        std::printf("%-8s %10llu %10llu %10.1f %10.1f %10.1f %10.1f\n", kind_names[k],
+                    static_cast<unsigned long long>(timeline.sent_count[k].load()),
+                    static_cast<unsigned long long>(timeline.delivered[k].load()),
+                    latency.percentile(0.50) / 1e3, latency.percentile(0.90) / 1e3,
+                    latency.percentile(0.99) / 1e3, latency.max() / 1e3);
+    }
+
+    sender.cleanup();
+    terminate(daemon_pid);
+    compositor.stop();
+    terminate(bus_pid);
+
+    return total_delivered == total_sent ? 0 : 1;
+}
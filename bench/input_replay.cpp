@@ -0,0 +1,390 @@
+// Replays an input capture (xdg-desktop-portal-hypr-remote --capture FILE)
+// through a real portal daemon.
+//
+// Like eis-bench it runs the daemon against a private dbus-daemon and the mock
+// compositor. Every captured session gets its own EIS connection (for EIS
+// input) or session handle (for Notify* calls), and its events are sent again
+// with their original spacing, scaled by --speed or back to back. Everything
+// the daemon does with them goes through Portal::handle_eis_event and the
+// Notify* handlers as it did when captured. Afterwards the Wayland requests
+// that arrived are compared with the ones in the capture.
+
+#include "input_capture.h"
+#include "latency_stats.h"
+#include "mock_compositor.h"
+#include "portal_harness.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libei.h>
+}
+
+struct Options {
+    std::string capture;
+    double speed = 1.0;                            // 0 = as fast as possible
+    std::string daemon = PORTAL_BINARY;
+    int64_t request_delay_us = 0;
+    double drain_timeout = 5.0;
+    bool verbose = false;
+};
+
+// Wayland requests, as the capture and the mock compositor both name them
+enum RequestKind {
+    MOTION, MOTION_ABSOLUTE, BUTTON, AXIS, AXIS_SOURCE, AXIS_STOP, FRAME, KEY, MODIFIERS, REQUEST_KIND_COUNT
+};
+static const char* request_names[REQUEST_KIND_COUNT] = {
+    "motion", "motion_abs", "button", "axis", "axis_source", "axis_stop", "frame", "key", "modifiers"
+};
+
+static int request_kind(CaptureType type) {
+    switch (type) {
+        case CaptureType::PointerMotion: return MOTION;
+        case CaptureType::PointerMotionAbsolute: return MOTION_ABSOLUTE;
+        case CaptureType::PointerButton: return BUTTON;
+        case CaptureType::PointerAxis: return AXIS;
+        case CaptureType::PointerAxisSource: return AXIS_SOURCE;
+        case CaptureType::PointerAxisStop: return AXIS_STOP;
+        case CaptureType::PointerFrame: return FRAME;
+        case CaptureType::KeyboardKey: return KEY;
+        case CaptureType::KeyboardModifiers: return MODIFIERS;
+        default: return -1;
+    }
+}
+
+static int request_kind(MockCompositor::RequestType type) {
+    using RequestType = MockCompositor::RequestType;
+    switch (type) {
+        case RequestType::PointerMotion: return MOTION;
+        case RequestType::PointerMotionAbsolute: return MOTION_ABSOLUTE;
+        case RequestType::PointerButton: return BUTTON;
+        case RequestType::PointerAxis:
+        case RequestType::PointerAxisDiscrete: return AXIS;
+        case RequestType::PointerAxisSource: return AXIS_SOURCE;
+        case RequestType::PointerAxisStop: return AXIS_STOP;
+        case RequestType::PointerFrame: return FRAME;
+        case RequestType::KeyboardKey: return KEY;
+        case RequestType::KeyboardModifiers: return MODIFIERS;
+        default: return -1;
+    }
+}
+
+// Client input, and sessions closing (which releases whatever they held)
+static bool is_input(const CaptureRecord& record) {
+    return record.source == CaptureSource::Eis || record.source == CaptureSource::DBus ||
+           (record.source == CaptureSource::Session && record.type == CaptureType::SessionClosed);
+}
+
+static std::string session_handle(uint32_t id) {
+    return "/org/freedesktop/portal/desktop/session/replay_" + std::to_string(id);
+}
+
+// Sends one captured client's input again
+class Replayer {
+public:
+    Replayer(sdbus::IConnection& connection) : connection(connection) {}
+
+    bool connect_eis(uint32_t session);
+    void pump();
+    // Returns how many records it consumed (a D-Bus scroll swallows the stop after it)
+    size_t send(const std::vector<CaptureRecord>& records, size_t index);
+
+private:
+    sdbus::IConnection& connection;
+    std::unique_ptr<sdbus::IProxy> proxy;
+    std::map<uint32_t, std::unique_ptr<Sender>> senders;
+
+    sdbus::IProxy& portal();
+    void send_eis(Sender& sender, const CaptureRecord& record);
+};
+
+bool Replayer::connect_eis(uint32_t session) {
+    int fd = connect_to_eis(connection, 10.0, session_handle(session), "input-replay");
+    auto sender = std::make_unique<Sender>();
+    if (fd < 0 || !sender->connect(fd, 5.0, "input-replay")) {
+        return false;
+    }
+    senders.emplace(session, std::move(sender));
+    return true;
+}
+
+void Replayer::pump() {
+    for (auto& [session, sender] : senders) {
+        sender->pump();
+    }
+}
+
+sdbus::IProxy& Replayer::portal() {
+    if (!proxy) {
+        proxy = sdbus::createProxy(connection, sdbus::ServiceName{PORTAL_NAME}, sdbus::ObjectPath{PORTAL_PATH});
+    }
+    return *proxy;
+}
+
+size_t Replayer::send(const std::vector<CaptureRecord>& records, size_t index) {
+    const CaptureRecord& record = records[index];
+    if (record.source == CaptureSource::Eis) {
+        auto it = senders.find(record.session);
+        if (it != senders.end()) {
+            send_eis(*it->second, record);
+        }
+        return 1;
+    }
+
+    sdbus::ObjectPath handle{session_handle(record.session)};
+    if (record.source == CaptureSource::Session) {
+        auto session = sdbus::createProxy(connection, sdbus::ServiceName{PORTAL_NAME}, handle);
+        session->callMethod("Close").onInterface("org.freedesktop.impl.portal.Session");
+        return 1;
+    }
+
+    // D-Bus calls are sent without waiting for their (empty) replies, as a
+    // client pushing input would
+    std::map<std::string, sdbus::Variant> options;
+    auto call = [&](const char* method, auto... args) {
+        portal().callMethod(method).onInterface(PORTAL_INTERFACE)
+            .withArguments(handle, options, args...).dontExpectReply();
+    };
+    switch (record.type) {
+        case CaptureType::Motion:
+            call("NotifyPointerMotion", record.d[0], record.d[1]);
+            return 1;
+        case CaptureType::Button:
+            call("NotifyPointerButton", static_cast<int32_t>(record.u[0]), record.u[1]);
+            return 1;
+        case CaptureType::Key:
+            call("NotifyKeyboardKeycode", static_cast<int32_t>(record.u[0]), record.u[1]);
+            return 1;
+        case CaptureType::Keysym:
+            call("NotifyKeyboardKeysym", static_cast<int32_t>(record.u[0]), record.u[1]);
+            return 1;
+        case CaptureType::ScrollDelta: {
+            // NotifyPointerAxis carries its stop as the "finish" option
+            size_t consumed = 1;
+            if (index + 1 < records.size()) {
+                const CaptureRecord& next = records[index + 1];
+                if (next.source == CaptureSource::DBus && next.session == record.session &&
+                    next.type == CaptureType::ScrollStop) {
+                    options["finish"] = sdbus::Variant(true);
+                    consumed = 2;
+                }
+            }
+            call("NotifyPointerAxis", record.d[0], record.d[1]);
+            return consumed;
+        }
+        case CaptureType::ScrollDiscrete: {
+            bool horizontal = record.i[0] != 0;
+            int32_t steps = (horizontal ? record.i[0] : record.i[1]) / 120;
+            call("NotifyPointerAxisDiscrete", static_cast<uint32_t>(horizontal ? 1 : 0), steps);
+            return 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+void Replayer::send_eis(Sender& sender, const CaptureRecord& record) {
+    switch (record.type) {
+        case CaptureType::Motion:
+            ei_device_pointer_motion(sender.pointer, record.d[0], record.d[1]);
+            break;
+        case CaptureType::MotionAbsolute:
+            ei_device_pointer_motion_absolute(sender.pointer, record.d[0], record.d[1]);
+            break;
+        case CaptureType::Button:
+            ei_device_button_button(sender.pointer, record.u[0], record.u[1] != 0);
+            break;
+        case CaptureType::ScrollDelta:
+            ei_device_scroll_delta(sender.pointer, record.d[0], record.d[1]);
+            break;
+        case CaptureType::ScrollDiscrete:
+            ei_device_scroll_discrete(sender.pointer, record.i[0], record.i[1]);
+            break;
+        case CaptureType::ScrollStop:
+            if (record.u[2]) {
+                ei_device_scroll_cancel(sender.pointer, record.u[0] != 0, record.u[1] != 0);
+            } else {
+                ei_device_scroll_stop(sender.pointer, record.u[0] != 0, record.u[1] != 0);
+            }
+            break;
+        case CaptureType::Key:
+            ei_device_keyboard_key(sender.keyboard, record.u[0], record.u[1] != 0);
+            break;
+        case CaptureType::Frame: {
+            bool keyboard = static_cast<CaptureDevice>(record.u[0]) == CaptureDevice::Keyboard;
+            ei_device_frame(keyboard ? sender.keyboard : sender.pointer, ei_now(sender.ei));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void usage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options] CAPTURE" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --speed X        Replay X times as fast as captured, 0 for as fast as possible (default 1)" << std::endl;
+    std::cout << "  --compositor-delay US  Time the mock compositor spends on every request (default 0)" << std::endl;
+    std::cout << "  --daemon PATH    Portal binary to replay against (default " << PORTAL_BINARY << ")" << std::endl;
+    std::cout << "  --verbose, -v    Show portal and dbus-daemon output" << std::endl;
+    std::cout << "  --help, -h       Show this help message" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--speed" && has_value) {
+            options.speed = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--compositor-delay" && has_value) {
+            options.request_delay_us = std::strtoll(argv[++i], nullptr, 10);
+        } else if (arg == "--daemon" && has_value) {
+            options.daemon = argv[++i];
+        } else if (arg == "--verbose" || arg == "-v") {
+            options.verbose = true;
+        } else if (arg[0] != '-' && options.capture.empty()) {
+            options.capture = arg;
+        } else {
+            usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    if (options.capture.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<CaptureRecord> records;
+    if (!read_capture(options.capture, records)) {
+        return 1;
+    }
+
+    // What is to be sent, which sessions need an EIS connection and what
+    // reached the compositor when the capture was taken
+    std::vector<CaptureRecord> input;
+    std::set<uint32_t> eis_sessions;
+    uint64_t captured[REQUEST_KIND_COUNT] = {};
+    for (const auto& record : records) {
+        if (is_input(record)) {
+            input.push_back(record);
+            if (record.source == CaptureSource::Eis) {
+                eis_sessions.insert(record.session);
+            }
+        } else if (record.source == CaptureSource::Wayland) {
+            int kind = request_kind(record.type);
+            if (kind >= 0) captured[kind]++;
+        }
+    }
+    if (input.empty()) {
+        std::cerr << options.capture << " holds no input events" << std::endl;
+        return 1;
+    }
+
+    pid_t bus_pid = -1;
+    std::string bus_address = start_private_bus(bus_pid);
+    if (bus_address.empty()) {
+        std::cerr << "Failed to start a private dbus-daemon" << std::endl;
+        terminate(bus_pid);
+        return 1;
+    }
+
+    std::atomic<uint64_t> replayed[REQUEST_KIND_COUNT] = {};
+    std::atomic<uint64_t> last_request_ns{0};
+    MockCompositor compositor;
+    compositor.set_recording(false);
+    compositor.set_request_delay(std::chrono::microseconds(options.request_delay_us));
+    compositor.set_request_listener([&](const MockCompositor::Request& request) {
+        int kind = request_kind(request.type);
+        if (kind >= 0) replayed[kind]++;
+        last_request_ns.store(request.received_ns, std::memory_order_relaxed);
+    });
+    if (!compositor.start()) {
+        terminate(bus_pid);
+        return 1;
+    }
+
+    setenv("DBUS_SESSION_BUS_ADDRESS", bus_address.c_str(), 1);
+    setenv("WAYLAND_DISPLAY", compositor.socket_name().c_str(), 1);
+    pid_t daemon_pid = spawn({options.daemon}, options.verbose);
+
+    int exit_code = 1;
+    try {
+        auto connection = sdbus::createSessionBusConnection();
+        Replayer replayer(*connection);
+        bool connected = true;
+        for (uint32_t session : eis_sessions) {
+            if (!replayer.connect_eis(session)) {
+                std::cerr << "Could not connect captured session " << session << " to EIS" << std::endl;
+                connected = false;
+                break;
+            }
+        }
+
+        if (connected) {
+            std::cout << "Replaying " << input.size() << " input events from " << eis_sessions.size()
+                      << " EIS session(s) ";
+            if (options.speed > 0) {
+                std::cout << "at " << options.speed << "x captured speed" << std::endl;
+            } else {
+                std::cout << "as fast as possible" << std::endl;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            uint64_t first_ns = input.front().time_ns;
+            size_t sends = 0;
+            for (size_t i = 0; i < input.size();) {
+                if (options.speed > 0) {
+                    double offset = (input[i].time_ns - first_ns) / 1e9 / options.speed;
+                    std::this_thread::sleep_until(start + std::chrono::duration<double>(offset));
+                }
+                i += replayer.send(input, i);
+                if (++sends % 64 == 0) {
+                    replayer.pump();
+                }
+            }
+            double send_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // Done once the compositor has been quiet for a while
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(options.drain_timeout);
+            while (std::chrono::steady_clock::now() < deadline) {
+                replayer.pump();
+                uint64_t last = last_request_ns.load(std::memory_order_relaxed);
+                if (last != 0 && LatencyTracker::now_ns() - last > 200'000'000) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            std::printf("\nsent %zu events in %.3f s\n\n", input.size(), send_seconds);
+            // Motion and scroll are coalesced differently whenever timing
+            // differs, so only buttons and keys are expected to match exactly
+            std::printf("%-12s %10s %10s\n", "request", "captured", "replayed");
+            exit_code = 0;
+            for (int k = 0; k < REQUEST_KIND_COUNT; k++) {
+                uint64_t got = replayed[k].load();
+                std::printf("%-12s %10llu %10llu\n", request_names[k],
+                            static_cast<unsigned long long>(captured[k]), static_cast<unsigned long long>(got));
+                if ((k == BUTTON || k == KEY) && got != captured[k]) {
+                    exit_code = 1;
+                }
+            }
+        }
+    } catch (const sdbus::Error& e) {
+        std::cerr << "D-Bus error: " << e.what() << std::endl;
+        exit_code = 1;
+    }
+
+    terminate(daemon_pid);
+    compositor.stop();
+    terminate(bus_pid);
+    return exit_code;
+}
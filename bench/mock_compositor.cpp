@@ -0,0 +1,268 @@
+#include "mock_compositor.h"
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+
+extern "C" {
+#include "virtual-keyboard-unstable-v1-server-protocol.h"
+#include "wlr-virtual-pointer-unstable-v1-server-protocol.h"
+}
+
+using RequestType = MockCompositor::RequestType;
+
+static uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+MockCompositor::MockCompositor() {
+}
+
+MockCompositor::~MockCompositor() {
+    stop();
+}
+
+void MockCompositor::add_output(int32_t x, int32_t y, int32_t width, int32_t height, int32_t scale) {
+    outputs.push_back(Output{x, y, width, height, scale});
+}
+
+bool MockCompositor::start() {
+    display = wl_display_create();
+    if (!display) {
+        std::cerr << "Failed to create Wayland display" << std::endl;
+        return false;
+    }
+
+    const char* name = wl_display_add_socket_auto(display);
+    if (!name) {
+        std::cerr << "Failed to create Wayland socket" << std::endl;
+        wl_display_destroy(display);
+        display = nullptr;
+        return false;
+    }
+    socket = name;
+
+    wl_global_create(display, &wl_seat_interface, 1, this, bind_seat);
+    if (outputs.empty()) {
+        add_output(0, 0, 1920, 1080);
+    }
+    for (Output& output : outputs) {
+        wl_global_create(display, &wl_output_interface, 2, &output, bind_output);
+    }
+    wl_global_create(display, &zwp_virtual_keyboard_manager_v1_interface, 1, this, bind_keyboard_manager);
+    wl_global_create(display, &zwlr_virtual_pointer_manager_v1_interface, 2, this, bind_pointer_manager);
+
+    running = true;
+    thread = std::thread(&MockCompositor::run, this);
+    return true;
+}
+
+void MockCompositor::stop() {
+    if (!display) return;
+
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    wl_display_destroy_clients(display);
+    wl_display_destroy(display);
+    display = nullptr;
+}
+
+void MockCompositor::run() {
+    struct wl_event_loop* loop = wl_display_get_event_loop(display);
+    while (running) {
+        if (paused) {
+            // Leave client data in the socket, as a compositor stuck on a frame would
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        wl_event_loop_dispatch(loop, 50);
+        wl_display_flush_clients(display);
+    }
+}
+
+void MockCompositor::set_request_listener(RequestListener new_listener) {
+    std::lock_guard<std::mutex> lock(mutex);
+    listener = std::move(new_listener);
+}
+
+std::vector<MockCompositor::Request> MockCompositor::requests() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return recorded;
+}
+
+void MockCompositor::clear_requests() {
+    std::lock_guard<std::mutex> lock(mutex);
+    recorded.clear();
+}
+
+void MockCompositor::receive(RequestType type, uint32_t time,
+                             std::initializer_list<uint32_t> args,
+                             std::initializer_list<double> values) {
+    Request request{type, now_ns(), time, {}, {}};
+    std::copy(args.begin(), args.begin() + std::min<size_t>(args.size(), 4), request.args);
+    std::copy(values.begin(), values.begin() + std::min<size_t>(values.size(), 2), request.values);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (recording) {
+            recorded.push_back(request);
+        }
+        if (listener) {
+            listener(request);
+        }
+    }
+
+    int64_t delay = request_delay_us.load(std::memory_order_relaxed);
+    if (delay > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+    }
+}
+
+void MockCompositor::destroy_resource(struct wl_client*, struct wl_resource* resource) {
+    wl_resource_destroy(resource);
+}
+
+const void* MockCompositor::seat_impl() {
+    static const struct wl_seat_interface impl = {
+        .get_pointer = [](struct wl_client*, struct wl_resource*, uint32_t) {},
+        .get_keyboard = [](struct wl_client* client, struct wl_resource* seat, uint32_t id) {
+            // Sends no keymap, so clients stay on their default layout
+            static const struct wl_keyboard_interface keyboard_impl = {
+                .release = destroy_resource,
+            };
+            struct wl_resource* resource = wl_resource_create(client, &wl_keyboard_interface,
+                                                              wl_resource_get_version(seat), id);
+            wl_resource_set_implementation(resource, &keyboard_impl, nullptr, nullptr);
+        },
+        .get_touch = [](struct wl_client*, struct wl_resource*, uint32_t) {},
+        .release = destroy_resource,
+    };
+    return &impl;
+}
+
+const void* MockCompositor::output_impl() {
+    static const struct wl_output_interface impl = {
+        .release = destroy_resource,
+    };
+    return &impl;
+}
+
+const void* MockCompositor::keyboard_manager_impl() {
+    static const struct zwp_virtual_keyboard_manager_v1_interface impl = {
+        .create_virtual_keyboard = create_keyboard,
+    };
+    return &impl;
+}
+
+const void* MockCompositor::keyboard_impl() {
+    static const struct zwp_virtual_keyboard_v1_interface impl = {
+        .keymap = [](struct wl_client*, struct wl_resource* resource, uint32_t format, int32_t fd, uint32_t size) {
+            close(fd);
+            from(resource)->receive(RequestType::KeyboardKeymap, 0, {format, size});
+        },
+        .key = [](struct wl_client*, struct wl_resource* resource, uint32_t time, uint32_t key, uint32_t state) {
+            from(resource)->receive(RequestType::KeyboardKey, time, {key, state});
+        },
+        .modifiers = [](struct wl_client*, struct wl_resource* resource,
+                        uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group) {
+            from(resource)->receive(RequestType::KeyboardModifiers, 0, {depressed, latched, locked, group});
+        },
+        .destroy = destroy_resource,
+    };
+    return &impl;
+}
+
+const void* MockCompositor::pointer_manager_impl() {
+    static const struct zwlr_virtual_pointer_manager_v1_interface impl = {
+        .create_virtual_pointer = create_pointer,
+        .destroy = destroy_resource,
+        .create_virtual_pointer_with_output = create_pointer_with_output,
+    };
+    return &impl;
+}
+
+const void* MockCompositor::pointer_impl() {
+    static const struct zwlr_virtual_pointer_v1_interface impl = {
+        .motion = [](struct wl_client*, struct wl_resource* resource, uint32_t time, wl_fixed_t dx, wl_fixed_t dy) {
+            from(resource)->receive(RequestType::PointerMotion, time, {},
+                                    {wl_fixed_to_double(dx), wl_fixed_to_double(dy)});
+        },
+        .motion_absolute = [](struct wl_client*, struct wl_resource* resource, uint32_t time,
+                              uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent) {
+            from(resource)->receive(RequestType::PointerMotionAbsolute, time, {x, y, x_extent, y_extent});
+        },
+        .button = [](struct wl_client*, struct wl_resource* resource, uint32_t time, uint32_t button, uint32_t state) {
+            from(resource)->receive(RequestType::PointerButton, time, {button, state});
+        },
+        .axis = [](struct wl_client*, struct wl_resource* resource, uint32_t time, uint32_t axis, wl_fixed_t value) {
+            from(resource)->receive(RequestType::PointerAxis, time, {axis}, {wl_fixed_to_double(value)});
+        },
+        .frame = [](struct wl_client*, struct wl_resource* resource) {
+            from(resource)->receive(RequestType::PointerFrame, 0);
+        },
+        .axis_source = [](struct wl_client*, struct wl_resource* resource, uint32_t source) {
+            from(resource)->receive(RequestType::PointerAxisSource, 0, {source});
+        },
+        .axis_stop = [](struct wl_client*, struct wl_resource* resource, uint32_t time, uint32_t axis) {
+            from(resource)->receive(RequestType::PointerAxisStop, time, {axis});
+        },
+        .axis_discrete = [](struct wl_client*, struct wl_resource* resource, uint32_t time, uint32_t axis,
+                            wl_fixed_t value, int32_t discrete) {
+            from(resource)->receive(RequestType::PointerAxisDiscrete, time,
+                                    {axis, static_cast<uint32_t>(discrete)}, {wl_fixed_to_double(value)});
+        },
+        .destroy = destroy_resource,
+    };
+    return &impl;
+}
+
+void MockCompositor::bind_seat(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &wl_seat_interface, version, id);
+    wl_resource_set_implementation(resource, seat_impl(), data, nullptr);
+    wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER | WL_SEAT_CAPABILITY_KEYBOARD);
+}
+
+void MockCompositor::bind_output(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    const Output* output = static_cast<const Output*>(data);
+    struct wl_resource* resource = wl_resource_create(client, &wl_output_interface, version, id);
+    wl_resource_set_implementation(resource, output_impl(), nullptr, nullptr);
+    wl_output_send_geometry(resource, output->x, output->y, 0, 0, WL_OUTPUT_SUBPIXEL_UNKNOWN,
+                            "mock", "mock", WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT,
+                        output->width * output->scale, output->height * output->scale, 60000);
+    if (version >= 2) {
+        wl_output_send_scale(resource, output->scale);
+        wl_output_send_done(resource);
+    }
+}
+
+void MockCompositor::bind_keyboard_manager(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &zwp_virtual_keyboard_manager_v1_interface, version, id);
+    wl_resource_set_implementation(resource, keyboard_manager_impl(), data, nullptr);
+}
+
+void MockCompositor::bind_pointer_manager(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &zwlr_virtual_pointer_manager_v1_interface, version, id);
+    wl_resource_set_implementation(resource, pointer_manager_impl(), data, nullptr);
+}
+
+void MockCompositor::create_keyboard(struct wl_client* client, struct wl_resource* manager,
+                                     struct wl_resource*, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &zwp_virtual_keyboard_v1_interface,
+                                                      wl_resource_get_version(manager), id);
+    wl_resource_set_implementation(resource, keyboard_impl(), from(manager), nullptr);
+}
+
+void MockCompositor::create_pointer(struct wl_client* client, struct wl_resource* manager,
+                                    struct wl_resource*, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &zwlr_virtual_pointer_v1_interface,
+                                                      wl_resource_get_version(manager), id);
+    wl_resource_set_implementation(resource, pointer_impl(), from(manager), nullptr);
+}
+
+void MockCompositor::create_pointer_with_output(struct wl_client* client, struct wl_resource* manager,
+                                                struct wl_resource* seat, struct wl_resource*, uint32_t id) {
+    create_pointer(client, manager, seat, id);
+}
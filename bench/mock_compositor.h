@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <wayland-server.h>
+}
+
+// Stand-in compositor for headless tests and benchmarks. It advertises wl_seat,
+// wl_output, zwp_virtual_keyboard_manager_v1 and zwlr_virtual_pointer_manager_v1
+// on its own socket, serves them from a background thread and records every request
+// the virtual devices send, stamped with the time it was received.
+class MockCompositor {
+public:
+    enum class RequestType {
+        KeyboardKeymap,
+        KeyboardKey,
+        KeyboardModifiers,
+        PointerMotion,
+        PointerMotionAbsolute,
+        PointerButton,
+        PointerAxis,
+        PointerAxisSource,
+        PointerAxisStop,
+        PointerAxisDiscrete,
+        PointerFrame,
+    };
+
+    struct Request {
+        RequestType type;
+        uint64_t received_ns;   // steady_clock, same clock as LatencyTracker::now_ns()
+        uint32_t time;          // the request's own timestamp, where it has one
+        // Integer arguments in protocol order after time: key/state,
+        // modifier masks, button/state, axis, x/y/extents, discrete steps...
+        uint32_t args[4];
+        // wl_fixed arguments: motion dx/dy, axis value
+        double values[2];
+    };
+
+    using RequestListener = std::function<void(const Request&)>;
+
+    MockCompositor();
+    ~MockCompositor();
+
+    // Monitors to advertise, set up before start(); one 1920x1080 output at
+    // 0,0 when none were added
+    void add_output(int32_t x, int32_t y, int32_t width, int32_t height, int32_t scale = 1);
+
+    bool start();
+    void stop();
+    // Value for WAYLAND_DISPLAY
+    const std::string& socket_name() const { return socket; }
+
+    // Called on the compositor thread for every request as it is received;
+    // must not call back into the compositor
+    void set_request_listener(RequestListener listener);
+    // Keep every request for requests(); on by default
+    void set_recording(bool enabled) { recording = enabled; }
+    std::vector<Request> requests() const;
+    void clear_requests();
+
+    // Slow-consumer simulation: spend this long on every request received
+    void set_request_delay(std::chrono::microseconds delay) { request_delay_us = delay.count(); }
+    // Stop reading from clients altogether so their socket buffers fill up
+    void pause_reading() { paused = true; }
+    void resume_reading() { paused = false; }
+
+private:
+    struct wl_display* display = nullptr;
+    std::string socket;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> paused{false};
+    std::atomic<bool> recording{true};
+    std::atomic<int64_t> request_delay_us{0};
+
+    struct Output {
+        int32_t x, y, width, height, scale;
+    };
+    std::list<Output> outputs;
+
+    mutable std::mutex mutex;
+    std::vector<Request> recorded;
+    RequestListener listener;
+
+    void run();
+    void receive(RequestType type, uint32_t time,
+                 std::initializer_list<uint32_t> args = {},
+                 std::initializer_list<double> values = {});
+
+    static MockCompositor* from(struct wl_resource* resource) {
+        return static_cast<MockCompositor*>(wl_resource_get_user_data(resource));
+    }
+
+    static void bind_seat(struct wl_client* client, void* data, uint32_t version, uint32_t id);
+    static void bind_output(struct wl_client* client, void* data, uint32_t version, uint32_t id);
+    static void bind_keyboard_manager(struct wl_client* client, void* data, uint32_t version, uint32_t id);
+    static void bind_pointer_manager(struct wl_client* client, void* data, uint32_t version, uint32_t id);
+
+    static void create_keyboard(struct wl_client* client, struct wl_resource* manager,
+                                struct wl_resource* seat, uint32_t id);
+    static void create_pointer(struct wl_client* client, struct wl_resource* manager,
+                               struct wl_resource* seat, uint32_t id);
+    static void create_pointer_with_output(struct wl_client* client, struct wl_resource* manager,
+                                           struct wl_resource* seat, struct wl_resource* output, uint32_t id);
+    static void destroy_resource(struct wl_client* client, struct wl_resource* resource);
+
+    // Filled in by mock_compositor.cpp, where the generated server headers live
+    static const void* seat_impl();
+    static const void* output_impl();
+    static const void* keyboard_manager_impl();
+    static const void* keyboard_impl();
+    static const void* pointer_manager_impl();
+    static const void* pointer_impl();
+};
@@ -0,0 +1,198 @@
+#include "portal_harness.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+const char* PORTAL_NAME = "org.freedesktop.impl.portal.desktop.hypr-remote";
+const char* PORTAL_PATH = "/org/freedesktop/portal/desktop";
+const char* PORTAL_INTERFACE = "org.freedesktop.impl.portal.RemoteDesktop";
+
+pid_t spawn(const std::vector<std::string>& args, bool verbose) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    if (!verbose) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+    }
+
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    _exit(127);
+}
+
+void terminate(pid_t pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+std::string start_private_bus(pid_t& pid, const std::string& service_dir) {
+    std::string config = "--session";
+    if (!service_dir.empty()) {
+        // The stock session config, but activating only what is in service_dir
+        std::string path = service_dir + "/bus.conf";
+        std::ofstream file(path);
+        file << "<busconfig>\n"
+             << "  <type>session</type>\n"
+             << "  <listen>unix:tmpdir=/tmp</listen>\n"
+             << "  <servicedir>" << service_dir << "</servicedir>\n"
+             << "  <policy context=\"default\">\n"
+             << "    <allow send_destination=\"*\" eavesdrop=\"true\"/>\n"
+             << "    <allow eavesdrop=\"true\"/>\n"
+             << "    <allow own=\"*\"/>\n"
+             << "  </policy>\n"
+             << "</busconfig>\n";
+        if (!file) {
+            return "";
+        }
+        config = "--config-file=" + path;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return "";
+    }
+
+    pid = spawn({"dbus-daemon", config, "--nofork", "--nopidfile",
+                 "--print-address=" + std::to_string(fds[1])}, true);
+    close(fds[1]);
+
+    std::string address;
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    char c;
+    while (poll(&pfd, 1, 5000) > 0 && read(fds[0], &c, 1) == 1 && c != '\n') {
+        address += c;
+    }
+    close(fds[0]);
+    return address;
+}
+
+int connect_to_eis(sdbus::IConnection& connection, double timeout,
+                   const std::string& session_handle, const std::string& app_id) {
+    auto proxy = sdbus::createProxy(connection, sdbus::ServiceName{PORTAL_NAME}, sdbus::ObjectPath{PORTAL_PATH});
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+
+    while (true) {
+        try {
+            sdbus::UnixFd fd;
+            proxy->callMethod("ConnectToEIS")
+                .onInterface(PORTAL_INTERFACE)
+                .withArguments(sdbus::ObjectPath{session_handle}, app_id,
+                               std::map<std::string, sdbus::Variant>{})
+                .storeResultsTo(fd);
+            return fd.release();
+        } catch (const sdbus::Error& e) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                std::cerr << "ConnectToEIS failed: " << e.what() << std::endl;
+                return -1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+}
+
+bool Sender::connect(int fd, double timeout, const char* name) {
+    ei = ei_new_sender(nullptr);
+    ei_configure_name(ei, name);
+    if (ei_setup_backend_fd(ei, fd) != 0) {
+        std::cerr << "Failed to set up libei on the EIS fd" << std::endl;
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    struct pollfd pfd = {ei_get_fd(ei), POLLIN, 0};
+    while (!(pointer_ready && keyboard_ready)) {
+        if (disconnected || std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "Portal did not provide pointer and keyboard devices" << std::endl;
+            return false;
+        }
+        poll(&pfd, 1, 100);
+        pump();
+    }
+    return true;
+}
+
+bool Sender::pump() {
+    ei_dispatch(ei);
+    struct ei_event* event;
+    while ((event = ei_get_event(ei)) != nullptr) {
+        handle_event(event);
+        ei_event_unref(event);
+    }
+    return !disconnected;
+}
+
+void Sender::handle_event(struct ei_event* event) {
+    switch (ei_event_get_type(event)) {
+        case EI_EVENT_SEAT_ADDED:
+            ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                      EI_DEVICE_CAP_POINTER, EI_DEVICE_CAP_POINTER_ABSOLUTE, EI_DEVICE_CAP_BUTTON,
+                                      EI_DEVICE_CAP_SCROLL, EI_DEVICE_CAP_KEYBOARD, nullptr);
+            break;
+
+        case EI_EVENT_DEVICE_ADDED: {
+            struct ei_device* device = ei_event_get_device(event);
+            if (!pointer && ei_device_has_capability(device, EI_DEVICE_CAP_POINTER)) {
+                pointer = ei_device_ref(device);
+            } else if (!keyboard && ei_device_has_capability(device, EI_DEVICE_CAP_KEYBOARD)) {
+                keyboard = ei_device_ref(device);
+            }
+            break;
+        }
+
+        case EI_EVENT_DEVICE_RESUMED: {
+            struct ei_device* device = ei_event_get_device(event);
+            if (device == pointer || device == keyboard) {
+                ei_device_start_emulating(device, ++sequence);
+                (device == pointer ? pointer_ready : keyboard_ready) = true;
+            }
+            break;
+        }
+
+        case EI_EVENT_DEVICE_PAUSED: {
+            struct ei_device* device = ei_event_get_device(event);
+            (device == pointer ? pointer_ready : keyboard_ready) = false;
+            break;
+        }
+
+        case EI_EVENT_DISCONNECT:
+            disconnected = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Sender::cleanup() {
+    if (pointer) {
+        ei_device_unref(pointer);
+        pointer = nullptr;
+    }
+    if (keyboard) {
+        ei_device_unref(keyboard);
+        keyboard = nullptr;
+    }
+    if (ei) {
+        ei_unref(ei);
+        ei = nullptr;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Pieces shared by the tools that drive a real portal daemon end to end:
+// a private session bus, the daemon process and a libei sender on the EIS fd
+// it hands out.
+
+#include <sdbus-c++/sdbus-c++.h>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+extern "C" {
+#include <libei.h>
+}
+
+#ifndef PORTAL_BINARY
+#define PORTAL_BINARY "xdg-desktop-portal-hypr-remote"
+#endif
+
+extern const char* PORTAL_NAME;
+extern const char* PORTAL_PATH;
+extern const char* PORTAL_INTERFACE;
+
+// Runs argv with the current environment; stdout/stderr go to /dev/null unless verbose
+pid_t spawn(const std::vector<std::string>& args, bool verbose);
+void terminate(pid_t pid);
+
+// Starts a throwaway session bus and returns its address. With a service
+// directory the bus activates the .service files in it; activated services
+// inherit the current environment.
+std::string start_private_bus(pid_t& pid, const std::string& service_dir = "");
+
+// Calls ConnectToEIS for the given session, retrying until the daemon has
+// claimed its bus name; returns the EIS fd or -1
+int connect_to_eis(sdbus::IConnection& connection, double timeout,
+                   const std::string& session_handle, const std::string& app_id);
+
+// libei sender side: binds the portal's seat and emulates on its devices
+class Sender {
+public:
+    ~Sender() { cleanup(); }
+
+    bool connect(int fd, double timeout, const char* name);
+    void cleanup();
+    // Handle whatever the server sent without blocking; false once disconnected
+    bool pump();
+
+    struct ei* ei = nullptr;
+    struct ei_device* pointer = nullptr;
+    struct ei_device* keyboard = nullptr;
+
+private:
+    bool pointer_ready = false;
+    bool keyboard_ready = false;
+    bool disconnected = false;
+    uint32_t sequence = 0;
+
+    void handle_event(struct ei_event* event);
+};
@@ -21,6 +21,9 @@ pkgs.mkShell {
     libei
     sdbus-cpp
 
+    # Private bus for bench/eis_bench.cpp
+    dbus
+
     # Additional development tools
     gdb
     valgrind
@@ -0,0 +1,31 @@
+#include "client_clock.h"
+#include <algorithm>
+
+// How slowly the offset follows deliveries that are all later than the
+// fastest one; about a thousand events to close the gap
+static constexpr int64_t DRIFT_DIVISOR = 1024;
+
+uint64_t ClientClock::map(uint64_t client_us, uint64_t received_ns) {
+    uint64_t mapped = received_ns;
+    if (client_us != 0) {
+        int64_t client_ns = static_cast<int64_t>(client_us * 1000);
+        int64_t delta = static_cast<int64_t>(received_ns) - client_ns;
+        if (!synced || delta < offset_ns) {
+            offset_ns = delta;
+            synced = true;
+        } else {
+            offset_ns += (delta - offset_ns) / DRIFT_DIVISOR;
+        }
+        mapped = static_cast<uint64_t>(client_ns + offset_ns);
+    }
+
+    mapped = std::clamp(mapped, std::min(last_ns, received_ns), received_ns);
+    last_ns = std::max(last_ns, mapped);
+    return mapped;
+}
+
+void ClientClock::reset() {
+    synced = false;
+    offset_ns = 0;
+    last_ns = 0;
+}
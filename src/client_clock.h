@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Maps event timestamps taken on a client's clock onto our steady_clock.
+// libei stamps frames with ei_now(), CLOCK_MONOTONIC microseconds, but a client
+// behind a proxy or on another machine has its own base. The offset is the
+// smallest receive-minus-send difference seen, i.e. the fastest delivery, so
+// mapped times keep the client's spacing between events and transport jitter
+// doesn't reach the compositor. When every event arrives later than that, the
+// offset creeps after it to follow clock drift.
+class ClientClock {
+public:
+    // Our time (ns) for an event the client stamped client_us and we received
+    // at received_ns. Never later than received_ns and never earlier than the
+    // previous result. A zero stamp (none given) maps to received_ns.
+    uint64_t map(uint64_t client_us, uint64_t received_ns);
+    void reset();
+
+private:
+    bool synced = false;
+    int64_t offset_ns = 0;
+    uint64_t last_ns = 0;
+};
+
+// Wayland input event times are milliseconds from an unspecified base; ours is steady_clock
+inline uint32_t wayland_time(uint64_t ns) {
+    return static_cast<uint32_t>(ns / 1000000);
+}
@@ -0,0 +1,142 @@
+#include "event_loop.h"
+#include "logger.h"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+EventLoop::EventLoop() : epoll_fd(-1), wake_fd(-1), running(false) {
+}
+
+EventLoop::~EventLoop() {
+    cleanup();
+}
+
+bool EventLoop::init() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        LOG_ERROR("Failed to create epoll instance: " << strerror(errno));
+        return false;
+    }
+    
+    // Used by stop() to interrupt epoll_wait() from other threads
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        LOG_ERROR("Failed to create wakeup eventfd: " << strerror(errno));
+        cleanup();
+        return false;
+    }
+    
+    return add_fd(wake_fd, EPOLLIN, [this](uint32_t) {
+        uint64_t value;
+        while (read(wake_fd, &value, sizeof(value)) > 0) {
+        }
+    });
+}
+
+void EventLoop::cleanup() {
+    running = false;
+    handlers.clear();
+    prepare_hooks.clear();
+    
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+}
+
+bool EventLoop::add_fd(int fd, uint32_t events, Handler handler) {
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOG_ERROR("Failed to add fd " << fd << " to event loop: " << strerror(errno));
+        return false;
+    }
+    
+    handlers[fd] = std::make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modify_fd(int fd, uint32_t events) {
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        LOG_ERROR("Failed to modify fd " << fd << " in event loop: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::remove_fd(int fd) {
+    if (handlers.erase(fd) > 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+void EventLoop::add_prepare_hook(PrepareHook hook) {
+    prepare_hooks.push_back(std::move(hook));
+}
+
+void EventLoop::run() {
+    if (epoll_fd < 0) return;
+    
+    running = true;
+    
+    constexpr int max_events = 16;
+    struct epoll_event events[max_events];
+    
+    while (running) {
+        int timeout = -1;
+        for (auto& hook : prepare_hooks) {
+            int hook_timeout = hook();
+            if (hook_timeout >= 0 && (timeout < 0 || hook_timeout < timeout)) {
+                timeout = hook_timeout;
+            }
+        }
+        
+        if (!running) break;
+        
+        int count = epoll_wait(epoll_fd, events, max_events, timeout);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Event loop epoll_wait failed: " << strerror(errno));
+            break;
+        }
+        
+        if (count > 0) {
+            wakeup_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+        
+        for (int i = 0; i < count && running; i++) {
+            auto it = handlers.find(events[i].data.fd);
+            if (it == handlers.end()) continue; // removed by an earlier handler
+            
+            // Keep the handler alive even if it removes itself
+            std::shared_ptr<Handler> handler = it->second;
+            (*handler)(events[i].events);
+        }
+    }
+    
+    running = false;
+}
+
+void EventLoop::stop() {
+    running = false;
+    if (wake_fd >= 0) {
+        uint64_t value = 1;
+        ssize_t rc = write(wake_fd, &value, sizeof(value));
+        (void)rc;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Single epoll-based reactor. Every component registers its file descriptors
+// here instead of running its own polling thread, so an idle daemon sleeps in
+// one epoll_wait() with no timeout until something actually happens.
+class EventLoop {
+public:
+    // Receives the epoll event mask (EPOLLIN, EPOLLOUT, EPOLLHUP, ...)
+    using Handler = std::function<void(uint32_t events)>;
+    // Runs before every wait; returns the longest the loop may sleep in
+    // milliseconds, or -1 for no limit
+    using PrepareHook = std::function<int()>;
+    
+    EventLoop();
+    ~EventLoop();
+    
+    bool init();
+    void cleanup();
+    
+    bool add_fd(int fd, uint32_t events, Handler handler);
+    bool modify_fd(int fd, uint32_t events);
+    void remove_fd(int fd);
+    
+    void add_prepare_hook(PrepareHook hook);
+    
+    void run();
+    // Safe to call from any thread
+    void stop();
+    
+    // steady_clock time (ns) at which the fds being handled were reported
+    // ready; the closest we get to when their data arrived
+    uint64_t wakeup_time_ns() const { return wakeup_ns; }
+    
+private:
+    int epoll_fd;
+    int wake_fd;
+    std::atomic<bool> running;
+    uint64_t wakeup_ns = 0;
+    
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers;
+    std::vector<PrepareHook> prepare_hooks;
+};
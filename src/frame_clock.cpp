@@ -0,0 +1,96 @@
+#include "frame_clock.h"
+#include "event_loop.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+FrameClock::FrameClock() {
+    set_refresh(DEFAULT_REFRESH_MHZ);
+}
+
+FrameClock::~FrameClock() {
+    cleanup();
+}
+
+bool FrameClock::attach(EventLoop& loop, Tick on_tick) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        LOG_ERROR("Failed to create frame timer: " << strerror(errno));
+        return false;
+    }
+    if (!loop.add_fd(timer_fd, EPOLLIN, [this](uint32_t) { expired(); })) {
+        close(timer_fd);
+        timer_fd = -1;
+        return false;
+    }
+    event_loop = &loop;
+    tick = std::move(on_tick);
+    return true;
+}
+
+void FrameClock::cleanup() {
+    if (timer_fd < 0) return;
+    if (event_loop) {
+        event_loop->remove_fd(timer_fd);
+        event_loop = nullptr;
+    }
+    close(timer_fd);
+    timer_fd = -1;
+    armed = false;
+}
+
+void FrameClock::set_refresh(int32_t mhz) {
+    if (mhz <= 0) {
+        mhz = DEFAULT_REFRESH_MHZ;
+    }
+    uint64_t next = 1000000000000ull / static_cast<uint64_t>(mhz);
+    if (next != period) {
+        LOG_DEBUG("Frame clock: " << mhz / 1000.0 << " Hz, " << next << " ns per frame");
+        period = next;
+    }
+}
+
+void FrameClock::schedule() {
+    if (armed || timer_fd < 0) return;
+
+    // Just ahead of the next period boundary; if that is too close already,
+    // the motion waits for the one after
+    uint64_t lead = std::min(LEAD_NS, period / 4);
+    uint64_t now = monotonic_ns();
+    uint64_t deadline = (now / period + 1) * period - lead;
+    if (deadline <= now) {
+        deadline += period;
+    }
+
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000ull);
+    spec.it_value.tv_nsec = static_cast<long>(deadline % 1000000000ull);
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+        LOG_WARN("Failed to arm frame timer: " << strerror(errno));
+        return;
+    }
+    armed = true;
+}
+
+void FrameClock::expired() {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    armed = false;
+    ticks++;
+    if (tick) {
+        tick();
+    }
+}
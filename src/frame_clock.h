@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+class EventLoop;
+
+// Paces pointer motion to the display. With it, motion a client sent is
+// merged until shortly before the next refresh and goes out once per frame
+// instead of with every client frame. The cadence follows the fastest output's
+// current mode. A client without a surface of its own gets no presentation
+// feedback, so the phase against vblank is unknown; ticks sit on multiples
+// of the refresh period on CLOCK_MONOTONIC.
+//
+// The timer is one-shot and only armed while motion is waiting, so an idle
+// daemon still doesn't wake up.
+class FrameClock {
+public:
+    using Tick = std::function<void()>;
+
+    // Used until an output reports its refresh rate
+    static constexpr int32_t DEFAULT_REFRESH_MHZ = 60000;
+    // How long before the refresh a tick fires, at most a quarter of the period
+    static constexpr uint64_t LEAD_NS = 1000000;
+
+    FrameClock();
+    ~FrameClock();
+
+    FrameClock(const FrameClock&) = delete;
+    FrameClock& operator=(const FrameClock&) = delete;
+
+    // Register the timer with the event loop; tick runs on every expiry
+    bool attach(EventLoop& loop, Tick tick);
+    void cleanup();
+    bool attached() const { return timer_fd >= 0; }
+
+    // In mHz, as wl_output reports it; 0 or less falls back to the default
+    void set_refresh(int32_t mhz);
+    uint64_t period_ns() const { return period; }
+
+    // Arm the timer for the next tick unless it already is
+    void schedule();
+
+    uint64_t tick_count() const { return ticks; }
+
+private:
+    int timer_fd = -1;
+    EventLoop* event_loop = nullptr;
+    Tick tick;
+    uint64_t period = 0;
+    bool armed = false;
+    uint64_t ticks = 0;
+
+    void expired();
+};
@@ -0,0 +1,151 @@
+#include "input_capture.h"
+#include "logger.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Records buffered before they are written out
+static constexpr size_t BUFFER_RECORDS = 2048;
+
+static uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+InputCapture::InputCapture() {
+}
+
+InputCapture::~InputCapture() {
+    close();
+}
+
+bool InputCapture::open(const std::string& path) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open capture file " << path << ": " << strerror(errno));
+        return false;
+    }
+
+    CaptureHeader header = {};
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.record_size = sizeof(CaptureRecord);
+    if (!write_all(fd, &header, sizeof(header))) {
+        LOG_ERROR("Failed to write capture header: " << strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    buffer.reserve(BUFFER_RECORDS);
+    LOG_INFO("🎞️ Capturing input to " << path);
+    return true;
+}
+
+void InputCapture::close() {
+    if (fd < 0) return;
+    flush();
+    ::close(fd);
+    fd = -1;
+}
+
+void InputCapture::record(CaptureSource source, CaptureType type, uint32_t session,
+                          uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    if (CaptureRecord* record = append(source, type, session)) {
+        record->u[0] = a;
+        record->u[1] = b;
+        record->u[2] = c;
+        record->u[3] = d;
+    }
+}
+
+void InputCapture::record(CaptureSource source, CaptureType type, uint32_t session, double x, double y) {
+    if (CaptureRecord* record = append(source, type, session)) {
+        record->d[0] = x;
+        record->d[1] = y;
+    }
+}
+
+void InputCapture::flush() {
+    if (fd < 0 || buffer.empty()) return;
+    if (!write_all(fd, buffer.data(), buffer.size() * sizeof(CaptureRecord))) {
+        // Stop rather than leave a gap the replay would silently skip over
+        LOG_ERROR("Failed to write capture, stopping it: " << strerror(errno));
+        buffer.clear();
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    buffer.clear();
+}
+
+CaptureRecord* InputCapture::append(CaptureSource source, CaptureType type, uint32_t session) {
+    if (fd < 0) return nullptr;
+    if (buffer.size() >= BUFFER_RECORDS) {
+        flush();
+        if (fd < 0) return nullptr;
+    }
+    CaptureRecord& record = buffer.emplace_back();
+    record.time_ns = now_ns();
+    record.session = session;
+    record.source = source;
+    record.type = type;
+    memset(record.u, 0, sizeof(record.u));
+    return &record;
+}
+
+bool read_capture(const std::string& path, std::vector<CaptureRecord>& records) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open capture file " << path << ": " << strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CaptureHeader)) {
+        LOG_ERROR(path << " is not a capture file");
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        LOG_ERROR("Failed to map capture file " << path);
+        return false;
+    }
+
+    const CaptureHeader* header = static_cast<const CaptureHeader*>(data);
+    bool valid = memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == CAPTURE_VERSION &&
+                 header->record_size == sizeof(CaptureRecord);
+    if (valid) {
+        // A partial record at the end is a capture cut short; drop it
+        size_t count = (size - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+        const CaptureRecord* first = reinterpret_cast<const CaptureRecord*>(header + 1);
+        records.assign(first, first + count);
+    } else {
+        LOG_ERROR(path << " is not a version " << CAPTURE_VERSION << " capture file");
+    }
+    munmap(data, size);
+    return valid;
+}
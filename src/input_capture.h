@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Recording of the input stream the portal handled, for turning "laggy input"
+// reports into something that can be replayed (see bench/input_replay.cpp).
+//
+// The file is a 16 byte header followed by fixed-size 32 byte records in host
+// byte order, appended as they happen. It needs no index: a reader can mmap it
+// and treat everything after the header as an array of CaptureRecord, and a
+// capture cut short by a crash is valid up to its last whole record.
+enum class CaptureSource : uint16_t {
+    Session,    // a session came or went
+    Eis,        // event received from an EIS client
+    DBus,       // RemoteDesktop Notify* call
+    Wayland,    // request written to the compositor
+};
+
+enum class CaptureType : uint16_t {
+    // Session
+    SessionCreated,
+    SessionClosed,
+
+    // Eis and DBus input, payload as sent by the client
+    Motion,             // d[0] dx, d[1] dy
+    MotionAbsolute,     // d[0] x, d[1] y
+    Button,             // u[0] button, u[1] pressed
+    ScrollDelta,        // d[0] dx, d[1] dy
+    ScrollDiscrete,     // i[0] dx, i[1] dy (value120)
+    ScrollStop,         // u[0] x, u[1] y, u[2] cancel
+    Key,                // u[0] evdev keycode, u[1] pressed
+    Keysym,             // u[0] keysym, u[1] pressed (DBus only)
+    Frame,              // u[0] CaptureDevice; Eis only
+
+    // Wayland requests, arguments in protocol order after time
+    PointerMotion,          // d[0] dx, d[1] dy
+    PointerMotionAbsolute,  // u[0] x, u[1] y, u[2] x_extent, u[3] y_extent
+    PointerButton,          // u[0] button, u[1] state
+    PointerAxis,            // u[0] axis, i[1] discrete steps, d[1] value
+    PointerAxisSource,      // u[0] source
+    PointerAxisStop,        // u[0] axis
+    PointerFrame,
+    KeyboardKey,            // u[0] key, u[1] state
+    KeyboardModifiers,      // u[0] depressed, u[1] latched, u[2] locked, u[3] group
+};
+
+// The device an EIS frame closed
+enum class CaptureDevice : uint32_t {
+    Pointer,
+    Keyboard,
+};
+
+struct CaptureRecord {
+    uint64_t time_ns;       // CLOCK_MONOTONIC, as steady_clock
+    uint32_t session;       // Session::id, 0 for none
+    CaptureSource source;
+    CaptureType type;
+    union {
+        uint32_t u[4];
+        int32_t i[4];
+        double d[2];
+    };
+};
+static_assert(sizeof(CaptureRecord) == 32, "capture records are fixed-size");
+
+struct CaptureHeader {
+    char magic[8];          // CAPTURE_MAGIC
+    uint32_t version;       // CAPTURE_VERSION
+    uint32_t record_size;   // sizeof(CaptureRecord)
+};
+static_assert(sizeof(CaptureHeader) == 16, "capture header is fixed-size");
+
+inline constexpr char CAPTURE_MAGIC[8] = {'H', 'R', 'D', 'C', 'A', 'P', 'T', '\0'};
+inline constexpr uint32_t CAPTURE_VERSION = 1;
+
+// Appends records to a capture file. record() only copies into a buffer,
+// which goes to the file when full and whenever flush() is called, so the
+// cost while recording is a memcpy per event. Event loop thread only.
+class InputCapture {
+public:
+    InputCapture();
+    ~InputCapture();
+
+    InputCapture(const InputCapture&) = delete;
+    InputCapture& operator=(const InputCapture&) = delete;
+
+    // Create (or truncate) the file and write its header
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return fd >= 0; }
+
+    void record(CaptureSource source, CaptureType type, uint32_t session,
+                uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+    void record(CaptureSource source, CaptureType type, uint32_t session, double x, double y);
+    // For mixed payloads: a zeroed record to fill in, or nullptr while not recording
+    CaptureRecord* append(CaptureSource source, CaptureType type, uint32_t session);
+
+    // Write out whatever is buffered
+    void flush();
+
+private:
+    int fd = -1;
+    std::vector<CaptureRecord> buffer;
+};
+
+// Read a whole capture, checking its header; false if it isn't one
+bool read_capture(const std::string& path, std::vector<CaptureRecord>& records);
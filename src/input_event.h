@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// One unit of input on its way to the compositor. Every frontend (EIS
+// sessions, RemoteDesktop D-Bus calls, the libei receiver) translates what
+// its client sent into these and hands them to a single consumer, which owns
+// the virtual devices and is where coalescing, queueing and accounting happen.
+enum class InputEventType : uint32_t {
+    Motion,             // d[0] dx, d[1] dy
+    MotionAbsolute,     // u[0] x, u[1] y, u[2] x_extent, u[3] y_extent
+    Button,             // u[0] evdev button, u[1] state
+    ScrollDelta,        // d[0] dx, d[1] dy; flags INPUT_SCROLL_CONTINUOUS unless from a finger
+    ScrollDiscrete,     // i[0] dx, i[1] dy, in 120ths of a notch
+    ScrollStop,         // u[0] x, u[1] y
+    Key,                // u[0] evdev keycode, u[1] state, u[2] modifiers to hold while pressed
+    Frame,              // the client's frame ends: send what it left pending
+};
+inline constexpr size_t INPUT_EVENT_TYPE_COUNT = static_cast<size_t>(InputEventType::Frame) + 1;
+
+// Label for metrics
+inline const char* to_string(InputEventType type) {
+    switch (type) {
+        case InputEventType::Motion: return "motion";
+        case InputEventType::MotionAbsolute: return "motion_absolute";
+        case InputEventType::Button: return "button";
+        case InputEventType::ScrollDelta: return "scroll_delta";
+        case InputEventType::ScrollDiscrete: return "scroll_discrete";
+        case InputEventType::ScrollStop: return "scroll_stop";
+        case InputEventType::Key: return "key";
+        case InputEventType::Frame: return "frame";
+    }
+    return "unknown";
+}
+
+// Fixed-size and trivially copyable, so events can be stored and copied in bulk.
+// Every frontend runs on the event loop thread and submits in arrival order,
+// so events carry no sequence number of their own.
+struct InputEvent {
+    uint32_t session;   // Session::id, 0 for the libei receiver
+    uint32_t time;      // Wayland time (ms)
+    InputEventType type;
+    uint32_t flags;
+    union {
+        uint32_t u[4];
+        int32_t i[4];
+        double d[2];
+    };
+};
+static_assert(std::is_trivially_copyable_v<InputEvent>, "input events are plain data");
+static_assert(sizeof(InputEvent) == 32, "input events are fixed-size");
+
+// ScrollDelta from a source that never sends a scroll stop
+inline constexpr uint32_t INPUT_SCROLL_CONTINUOUS = 1u << 0;
+
+inline InputEvent make_input_event(InputEventType type, uint32_t session, uint32_t time) {
+    InputEvent event = {};
+    event.session = session;
+    event.time = time;
+    event.type = type;
+    return event;
+}
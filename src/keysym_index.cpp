@@ -0,0 +1,44 @@
+#include "keysym_index.h"
+#include <bit>
+
+void KeysymIndex::rebuild(struct xkb_keymap* keymap) {
+    entries.clear();
+    if (!keymap) return;
+    
+    xkb_keymap_key_for_each(keymap, add_key, this);
+}
+
+const KeysymIndex::Entry* KeysymIndex::lookup(xkb_keysym_t keysym) const {
+    auto it = entries.find(keysym);
+    return it != entries.end() ? &it->second : nullptr;
+}
+
+void KeysymIndex::add_key(struct xkb_keymap* keymap, xkb_keycode_t keycode, void* data) {
+    KeysymIndex* self = static_cast<KeysymIndex*>(data);
+    
+    // XKB keycodes are offset by 8 from Linux keycodes
+    if (keycode < 8) return;
+    
+    // Only the first layout is indexed; that is the one the virtual keyboard uses
+    const xkb_layout_index_t layout = 0;
+    if (xkb_keymap_num_layouts_for_key(keymap, keycode) == 0) return;
+    
+    const xkb_level_index_t num_levels = xkb_keymap_num_levels_for_key(keymap, keycode, layout);
+    for (xkb_level_index_t level = 0; level < num_levels; level++) {
+        const xkb_keysym_t* syms = nullptr;
+        int num_syms = xkb_keymap_key_get_syms_by_level(keymap, keycode, layout, level, &syms);
+        if (num_syms != 1) continue;
+        
+        // Several mask combinations can select a level; the first one is the simplest
+        xkb_mod_mask_t mask = 0;
+        if (xkb_keymap_key_get_mods_for_level(keymap, keycode, layout, level, &mask, 1) == 0) continue;
+        
+        Entry entry{keycode - 8, mask};
+        auto [it, inserted] = self->entries.try_emplace(syms[0], entry);
+        
+        // Prefer the key that needs the fewest modifiers (e.g. keypad vs. shifted digit)
+        if (!inserted && std::popcount(mask) < std::popcount(it->second.mods)) {
+            it->second = entry;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <xkbcommon/xkbcommon.h>
+
+// Reverse lookup from keysym to the key that produces it in a compiled keymap.
+// Built once per keymap so keysym injection does not touch xkbcommon per event.
+class KeysymIndex {
+public:
+    struct Entry {
+        uint32_t keycode;       // Linux evdev keycode (XKB keycode - 8)
+        xkb_mod_mask_t mods;    // Modifiers that must be held to reach the keysym
+    };
+    
+    // Rebuild the index from the given keymap; call again when the layout changes
+    void rebuild(struct xkb_keymap* keymap);
+    void clear() { entries.clear(); }
+    
+    const Entry* lookup(xkb_keysym_t keysym) const;
+    size_t size() const { return entries.size(); }
+    
+private:
+    std::unordered_map<xkb_keysym_t, Entry> entries;
+    
+    static void add_key(struct xkb_keymap* keymap, xkb_keycode_t keycode, void* data);
+};
@@ -0,0 +1,180 @@
+#include "latency_stats.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+const char* to_string(LatencyStage stage) {
+    switch (stage) {
+        case LatencyStage::Dispatch: return "dispatch";
+        case LatencyStage::Flush: return "flush";
+        case LatencyStage::Total: return "total";
+        default: return "unknown";
+    }
+}
+
+const char* to_string(InputEventKind kind) {
+    switch (kind) {
+        case InputEventKind::PointerMotion: return "pointer_motion";
+        case InputEventKind::PointerMotionAbsolute: return "pointer_motion_absolute";
+        case InputEventKind::PointerButton: return "pointer_button";
+        case InputEventKind::PointerScroll: return "pointer_scroll";
+        case InputEventKind::KeyboardKey: return "keyboard_key";
+        default: return "unknown";
+    }
+}
+
+size_t LatencyHistogram::bucket_index(uint64_t ns) {
+    // The first two powers of two are stored exactly; above that every power
+    // of two gets sub_bucket_count buckets of equal width
+    if (ns < 2 * sub_bucket_count) {
+        return static_cast<size_t>(ns);
+    }
+    int shift = std::bit_width(ns) - (sub_bucket_bits + 1);
+    size_t index = (shift + 1) * sub_bucket_count + ((ns >> shift) - sub_bucket_count);
+    return std::min(index, bucket_count - 1);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t index) {
+    if (index < 2 * sub_bucket_count) {
+        return index;
+    }
+    int shift = static_cast<int>(index / sub_bucket_count) - 1;
+    uint64_t low = (sub_bucket_count + index % sub_bucket_count) << shift;
+    return low + (1ull << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t current = maximum.load(std::memory_order_relaxed);
+    while (ns > current && !maximum.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+    uint64_t samples = count();
+    if (samples == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) * samples));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Never report more than was actually recorded
+            return std::min(bucket_upper_bound(i), max());
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+    total_ns.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyTracker::now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+LatencySet* LatencyTracker::session(const std::string& name) {
+    auto& entry = sessions[name];
+    if (!entry) {
+        entry = std::make_unique<LatencySet>();
+    }
+    return entry.get();
+}
+
+void LatencyTracker::remove_session(const std::string& name) {
+    auto it = sessions.find(name);
+    if (it == sessions.end()) return;
+
+    for (size_t i = 0; i < pending_count; i++) {
+        if (pending[i].session == it->second.get()) {
+            pending[i].session = nullptr;
+        }
+    }
+    sessions.erase(it);
+}
+
+void LatencyTracker::record(LatencySet* session, LatencyStage stage, InputEventKind kind, uint64_t ns) {
+    all.at(stage, kind).record(ns);
+    if (session) {
+        session->at(stage, kind).record(ns);
+    }
+}
+
+void LatencyTracker::dispatched(LatencySet* session, InputEventKind kind, uint64_t readable_ns, uint64_t dispatch_ns) {
+    uint64_t ready = std::min(readable_ns, dispatch_ns);
+    record(session, LatencyStage::Dispatch, kind, dispatch_ns - ready);
+
+    if (pending_count < max_pending) {
+        pending[pending_count++] = Pending{session, kind, ready, dispatch_ns};
+    }
+}
+
+void LatencyTracker::flushed() {
+    if (pending_count == 0) return;
+
+    // One clock read completes the whole batch
+    uint64_t now = now_ns();
+    for (size_t i = 0; i < pending_count; i++) {
+        const Pending& event = pending[i];
+        record(event.session, LatencyStage::Flush, event.kind, now - event.dispatch_ns);
+        record(event.session, LatencyStage::Total, event.kind, now - event.readable_ns);
+    }
+    pending_count = 0;
+}
+
+std::vector<LatencyTracker::Summary> LatencyTracker::summarize() const {
+    std::vector<Summary> result;
+
+    auto append = [&result](const std::string& name, const LatencySet& set) {
+        for (size_t s = 0; s < static_cast<size_t>(LatencyStage::Count); s++) {
+            for (size_t k = 0; k < static_cast<size_t>(InputEventKind::Count); k++) {
+                const LatencyHistogram& histogram = set.histograms[s][k];
+                if (histogram.count() == 0) continue;
+                result.push_back(Summary{
+                    name,
+                    static_cast<LatencyStage>(s),
+                    static_cast<InputEventKind>(k),
+                    histogram.count(),
+                    histogram.percentile(0.50),
+                    histogram.percentile(0.99),
+                    histogram.max(),
+                    histogram.sum()
+                });
+            }
+        }
+    };
+
+    append("", all);
+    for (const auto& [name, set] : sessions) {
+        append(name, *set);
+    }
+    return result;
+}
+
+void LatencyTracker::reset() {
+    auto clear = [](LatencySet& set) {
+        for (auto& row : set.histograms) {
+            for (auto& histogram : row) {
+                histogram.reset();
+            }
+        }
+    };
+
+    clear(all);
+    for (auto& [name, set] : sessions) {
+        clear(*set);
+    }
+}
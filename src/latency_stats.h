@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where an input event is in its trip through the portal
+enum class LatencyStage {
+    Dispatch,   // socket readable -> event handled and queued for Wayland
+    Flush,      // event handled -> wl_display_flush() returned
+    Total,      // socket readable -> wl_display_flush() returned
+    Count
+};
+
+enum class InputEventKind {
+    PointerMotion,
+    PointerMotionAbsolute,
+    PointerButton,
+    PointerScroll,
+    KeyboardKey,
+    Count
+};
+
+const char* to_string(LatencyStage stage);
+const char* to_string(InputEventKind kind);
+
+// Log-linear (HDR-style) histogram of nanosecond latencies. Each power of two
+// is split into 16 linear buckets, so any reported value is within ~6% of the
+// recorded one. Recording is a relaxed atomic increment and never allocates.
+// Buckets count in 32 bits to keep a histogram near 2 KiB: one per stage and
+// event kind exists for every session, and the tracker is always on.
+class LatencyHistogram {
+public:
+    void record(uint64_t ns);
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+    // Every recorded value added up, for the mean (and a Prometheus _sum)
+    uint64_t sum() const { return total_ns.load(std::memory_order_relaxed); }
+    // Highest value equivalent to the given quantile (0.0 - 1.0)
+    uint64_t percentile(double quantile) const;
+    void reset();
+
+private:
+    static constexpr int sub_bucket_bits = 4;
+    static constexpr uint64_t sub_bucket_count = 1ull << sub_bucket_bits;
+    // Anything above ~68 seconds lands in the last bucket
+    static constexpr int max_value_bits = 36;
+    static constexpr size_t bucket_count = (max_value_bits - sub_bucket_bits + 1) * sub_bucket_count;
+
+    static size_t bucket_index(uint64_t ns);
+    static uint64_t bucket_upper_bound(size_t index);
+
+    std::array<std::atomic<uint32_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> maximum{0};
+    std::atomic<uint64_t> total_ns{0};
+};
+
+// One histogram per stage and event kind
+struct LatencySet {
+    LatencyHistogram histograms[static_cast<size_t>(LatencyStage::Count)][static_cast<size_t>(InputEventKind::Count)];
+
+    LatencyHistogram& at(LatencyStage stage, InputEventKind kind) {
+        return histograms[static_cast<size_t>(stage)][static_cast<size_t>(kind)];
+    }
+};
+
+// Collects per-stage latencies for every frontend (EIS, D-Bus Notify*, EI).
+// Events are stamped with the time their socket was reported readable, again
+// when they are dispatched and once more when the Wayland flush that carried
+// them returns. dispatched()/flushed() and session() must be called from the
+// event loop thread; the histograms themselves may be read from anywhere.
+class LatencyTracker {
+public:
+    struct Summary {
+        std::string session;   // empty for the aggregate over all sessions
+        LatencyStage stage;
+        InputEventKind kind;
+        uint64_t count;
+        uint64_t p50_ns;
+        uint64_t p99_ns;
+        uint64_t max_ns;
+        uint64_t sum_ns;
+    };
+
+    static uint64_t now_ns();
+
+    // Histograms for one session, created on first use. The pointer stays
+    // valid until remove_session() is called for the name.
+    LatencySet* session(const std::string& name);
+    // Forget a closed session's histograms. What it recorded stays in the
+    // aggregate; events still waiting for their flush only count there.
+    void remove_session(const std::string& name);
+
+    // An event read at readable_ns has been queued for the compositor. The
+    // caller reads the clock once per batch and passes it as dispatch_ns;
+    // nothing here reads it per event.
+    void dispatched(LatencySet* session, InputEventKind kind, uint64_t readable_ns, uint64_t dispatch_ns);
+    // wl_display_flush() returned; completes every event dispatched since the last flush
+    void flushed();
+
+    // Non-empty histograms only
+    std::vector<Summary> summarize() const;
+    void reset();
+
+private:
+    struct Pending {
+        LatencySet* session;
+        InputEventKind kind;
+        uint64_t readable_ns;
+        uint64_t dispatch_ns;
+    };
+
+    void record(LatencySet* session, LatencyStage stage, InputEventKind kind, uint64_t ns);
+
+    LatencySet all;
+    std::map<std::string, std::unique_ptr<LatencySet>> sessions;
+
+    // Events waiting for their flush; beyond this only the dispatch stage is kept
+    static constexpr size_t max_pending = 512;
+    std::array<Pending, max_pending> pending;
+    size_t pending_count = 0;
+};
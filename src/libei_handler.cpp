@@ -1,9 +1,9 @@
 #include "libei_handler.h"
-#include "wayland_virtual_keyboard.h"
-#include "wayland_virtual_pointer.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "latency_stats.h"
+#include "output_layout.h"
 #include <iostream>
-#include <chrono>
-#include <thread>
 #include <unistd.h>
 #include <sys/epoll.h>
 #include <cstring>
@@ -14,36 +14,36 @@ extern "C" {
 }
 
 LibEIHandler::LibEIHandler()
-    : ei_context(nullptr), seat(nullptr), keyboard(nullptr), pointer(nullptr), running(false) {
+    : ei_context(nullptr), seat(nullptr), event_loop(nullptr) {
 }
 
 LibEIHandler::~LibEIHandler() {
     cleanup();
 }
 
-bool LibEIHandler::init(WaylandVirtualKeyboard* kb, WaylandVirtualPointer* ptr) {
-    keyboard = kb;
-    pointer = ptr;
-    
-    std::cout << "Initializing LibEI Handler..." << std::endl;
+bool LibEIHandler::init() {
+    LOG_INFO("Initializing LibEI Handler...");
     
     // Create a new EI receiver context (we receive events from remote clients)
     ei_context = ei_new_receiver(this);
     if (!ei_context) {
-        std::cerr << "Failed to create EI receiver context" << std::endl;
+        LOG_ERROR("Failed to create EI receiver context");
         return false;
     }
     
     // Configure the name for this context
     ei_configure_name(ei_context, "Hyprland Remote Desktop Portal");
     
-    std::cout << "EI receiver context created for portal file descriptor sharing" << std::endl;
-    std::cout << "✓ LibEI Handler initialized successfully" << std::endl;
+    LOG_INFO("EI receiver context created for portal file descriptor sharing");
+    LOG_INFO("✓ LibEI Handler initialized successfully");
     return true;
 }
 
 void LibEIHandler::cleanup() {
-    running = false;
+    if (event_loop && ei_context) {
+        event_loop->remove_fd(ei_get_fd(ei_context));
+    }
+    event_loop = nullptr;
     
     if (seat) {
         ei_seat_unref(seat);
@@ -56,54 +56,50 @@ void LibEIHandler::cleanup() {
     }
 }
 
-void LibEIHandler::run() {
+bool LibEIHandler::attach(EventLoop& loop) {
     if (!ei_context) {
-        std::cout << "LibEI Handler not initialized, cannot run" << std::endl;
-        return;
+        LOG_WARN("LibEI Handler not initialized, cannot attach");
+        return false;
     }
     
-    running = true;
-    std::cout << "LibEI Handler running and processing events..." << std::endl;
-    
     int ei_fd = ei_get_fd(ei_context);
     if (ei_fd < 0) {
-        std::cerr << "Failed to get EI file descriptor" << std::endl;
-        return;
+        LOG_ERROR("Failed to get EI file descriptor");
+        return false;
     }
     
-    while (running) {
-        // Use select to wait for events with timeout
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(ei_fd, &fds);
-        
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 100000; // 100ms timeout
-        
-        int result = select(ei_fd + 1, &fds, nullptr, nullptr, &timeout);
-        
-        if (result > 0 && FD_ISSET(ei_fd, &fds)) {
-            // Dispatch events
-            ei_dispatch(ei_context);
-            struct ei_event* event;
-            while ((event = ei_get_event(ei_context)) != nullptr) {
-                handle_event(event);
-                ei_event_unref(event);
-            }
-        } else if (result < 0) {
-            std::cerr << "Error in select(): " << strerror(errno) << std::endl;
-            break;
-        }
-        // If result == 0, it's just a timeout, continue the loop
+    if (!loop.add_fd(ei_fd, EPOLLIN, [this](uint32_t) { dispatch(); })) {
+        return false;
     }
+    event_loop = &loop;
     
-    std::cout << "LibEI Handler stopped processing events" << std::endl;
+    LOG_INFO("LibEI Handler attached to event loop");
+    return true;
+}
+
+void LibEIHandler::set_reading(bool enabled) {
+    if (event_loop && ei_context) {
+        event_loop->modify_fd(ei_get_fd(ei_context), enabled ? EPOLLIN : 0);
+    }
 }
 
-void LibEIHandler::stop() {
-    running = false;
-    std::cout << "LibEI Handler stop requested" << std::endl;
+void LibEIHandler::dispatch() {
+    ei_dispatch(ei_context);
+    struct ei_event* event;
+    while ((event = ei_get_event(ei_context)) != nullptr) {
+        handle_event(event);
+        ei_event_unref(event);
+    }
+    
+    // Handed over together, so the portal handles them as one batch
+    if (!pending.empty()) {
+        if (input_sink) {
+            input_sink(pending);
+        } else {
+            dropped += pending.size();
+        }
+        pending.clear();
+    }
 }
 
 void LibEIHandler::handle_event(struct ei_event* event) {
@@ -111,21 +107,21 @@ void LibEIHandler::handle_event(struct ei_event* event) {
     
     switch (type) {
         case EI_EVENT_CONNECT:
-            std::cout << "EI: Client connected" << std::endl;
+            LOG_INFO("EI: Client connected");
             break;
             
         case EI_EVENT_DISCONNECT:
-            std::cout << "EI: Client disconnected" << std::endl;
+            LOG_INFO("EI: Client disconnected");
             break;
             
         case EI_EVENT_SEAT_ADDED:
-            std::cout << "EI: Seat added" << std::endl;
+            LOG_INFO("EI: Seat added");
             seat = ei_event_get_seat(event);
             ei_seat_ref(seat);
             break;
             
         case EI_EVENT_SEAT_REMOVED:
-            std::cout << "EI: Seat removed" << std::endl;
+            LOG_INFO("EI: Seat removed");
             if (seat) {
                 ei_seat_unref(seat);
                 seat = nullptr;
@@ -133,11 +129,11 @@ void LibEIHandler::handle_event(struct ei_event* event) {
             break;
             
         case EI_EVENT_DEVICE_ADDED:
-            std::cout << "EI: Device added" << std::endl;
+            LOG_INFO("EI: Device added");
             break;
             
         case EI_EVENT_DEVICE_REMOVED:
-            std::cout << "EI: Device removed" << std::endl;
+            LOG_INFO("EI: Device removed");
             break;
             
         case EI_EVENT_POINTER_MOTION:
@@ -154,6 +150,8 @@ void LibEIHandler::handle_event(struct ei_event* event) {
             
         case EI_EVENT_SCROLL_DELTA:
         case EI_EVENT_SCROLL_DISCRETE:
+        case EI_EVENT_SCROLL_STOP:
+        case EI_EVENT_SCROLL_CANCEL:
             handle_pointer_event(event);
             break;
             
@@ -163,60 +161,40 @@ void LibEIHandler::handle_event(struct ei_event* event) {
             
         case EI_EVENT_FRAME:
             // Frame events group related events together
-            // We can flush any pending events here
+            pending.push_back(make_input_event(InputEventType::Frame, 0, event_time(event)));
             break;
             
         default:
-            std::cout << "EI: Unhandled event type: " << type << std::endl;
+            LOG_DEBUG("EI: Unhandled event type: " << type);
             break;
     }
 }
 
 void LibEIHandler::handle_keyboard_event(struct ei_event* event) {
-    if (!keyboard) {
-        std::cout << "EI: Keyboard event received but no virtual keyboard available" << std::endl;
-        return;
-    }
-    
     enum ei_event_type type = ei_event_get_type(event);
     
     if (type == EI_EVENT_KEYBOARD_KEY) {
-        uint32_t keycode = ei_event_keyboard_get_key(event);
-        bool is_press = ei_event_keyboard_get_key_is_press(event);
-        
-        std::cout << "EI: Keyboard " << (is_press ? "press" : "release") << " keycode=" << keycode << std::endl;
+        InputEvent input = make_input_event(InputEventType::Key, 0, event_time(event));
+        input.u[0] = ei_event_keyboard_get_key(event);
+        input.u[1] = ei_event_keyboard_get_key_is_press(event) ? 1 : 0;
         
-        // Get current time for wayland events
-        uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count());
-        
-        // Forward to virtual keyboard
-        keyboard->send_key(time, keycode, is_press ? 1 : 0);
+        LOG_TRACE("EI: Keyboard " << (input.u[1] ? "press" : "release") << " keycode=" << input.u[0]);
+        pending.push_back(input);
     }
 }
 
 void LibEIHandler::handle_pointer_event(struct ei_event* event) {
-    if (!pointer) {
-        std::cout << "EI: Pointer event received but no virtual pointer available" << std::endl;
-        return;
-    }
-    
     enum ei_event_type type = ei_event_get_type(event);
-    
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
+    uint32_t time = event_time(event);
     
     switch (type) {
         case EI_EVENT_POINTER_MOTION: {
-            double dx = ei_event_pointer_get_dx(event);
-            double dy = ei_event_pointer_get_dy(event);
-            
-            std::cout << "EI: Pointer motion dx=" << dx << " dy=" << dy << std::endl;
+            InputEvent input = make_input_event(InputEventType::Motion, 0, time);
+            input.d[0] = ei_event_pointer_get_dx(event);
+            input.d[1] = ei_event_pointer_get_dy(event);
             
-            // Forward relative motion to virtual pointer
-            pointer->send_motion(time, dx, dy);
-            pointer->send_frame();
+            LOG_TRACE("EI: Pointer motion dx=" << input.d[0] << " dy=" << input.d[1]);
+            pending.push_back(input);
             break;
         }
         
@@ -224,62 +202,70 @@ void LibEIHandler::handle_pointer_event(struct ei_event* event) {
             double x = ei_event_pointer_get_absolute_x(event);
             double y = ei_event_pointer_get_absolute_y(event);
             
-            std::cout << "EI: Pointer absolute motion x=" << x << " y=" << y << std::endl;
+            LOG_TRACE("EI: Pointer absolute motion x=" << x << " y=" << y);
             
-            // For absolute motion, we need screen dimensions
-            // For now, assume 1920x1080 - this should be dynamically determined
-            uint32_t screen_width = 1920;
-            uint32_t screen_height = 1080;
-            
-            pointer->send_motion_absolute(time, 
-                static_cast<uint32_t>(x), static_cast<uint32_t>(y),
-                screen_width, screen_height);
-            pointer->send_frame();
+            // EI positions are in compositor-global logical coordinates
+            InputEvent input = make_input_event(InputEventType::MotionAbsolute, 0, time);
+            OutputLayout::Bounds bounds = outputs ? outputs->bounds() : OutputLayout::Bounds{};
+            if (!outputs || !outputs->to_absolute(x - bounds.x, y - bounds.y,
+                                                  input.u[0], input.u[1], input.u[2], input.u[3])) {
+                LOG_WARN("EI: Dropping absolute motion, no output geometry known");
+                dropped++;
+                break;
+            }
+            pending.push_back(input);
             break;
         }
         
         case EI_EVENT_BUTTON_BUTTON: {
-            uint32_t button = ei_event_button_get_button(event);
-            bool is_press = ei_event_button_get_is_press(event);
+            InputEvent input = make_input_event(InputEventType::Button, 0, time);
+            input.u[0] = ei_event_button_get_button(event);
+            input.u[1] = ei_event_button_get_is_press(event) ? 1 : 0;
             
-            std::cout << "EI: Button " << (is_press ? "press" : "release") << " button=" << button << std::endl;
-            
-            // Forward button event to virtual pointer
-            pointer->send_button(time, button, is_press ? 1 : 0);
-            pointer->send_frame();
+            LOG_TRACE("EI: Button " << (input.u[1] ? "press" : "release") << " button=" << input.u[0]);
+            pending.push_back(input);
             break;
         }
         
         case EI_EVENT_SCROLL_DELTA: {
-            double dx = ei_event_scroll_get_dx(event);
-            double dy = ei_event_scroll_get_dy(event);
-            
-            std::cout << "EI: Scroll delta dx=" << dx << " dy=" << dy << std::endl;
+            InputEvent input = make_input_event(InputEventType::ScrollDelta, 0, time);
+            input.d[0] = ei_event_scroll_get_dx(event);
+            input.d[1] = ei_event_scroll_get_dy(event);
             
-            // Send scroll events for both axes if non-zero
-            if (dx != 0.0) {
-                pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, dx, dy);
-            }
-            if (dy != 0.0) {
-                pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL, dy, dx);
-            }
-            pointer->send_frame();
+            LOG_TRACE("EI: Scroll delta dx=" << input.d[0] << " dy=" << input.d[1]);
+            pending.push_back(input);
             break;
         }
         
         case EI_EVENT_SCROLL_DISCRETE: {
-            int32_t dx = ei_event_scroll_get_discrete_dx(event);
-            int32_t dy = ei_event_scroll_get_discrete_dy(event);
+            InputEvent input = make_input_event(InputEventType::ScrollDiscrete, 0, time);
+            input.i[0] = ei_event_scroll_get_discrete_dx(event);
+            input.i[1] = ei_event_scroll_get_discrete_dy(event);
             
-            std::cout << "EI: Scroll discrete dx=" << dx << " dy=" << dy << std::endl;
+            LOG_TRACE("EI: Scroll discrete dx=" << input.i[0] << " dy=" << input.i[1]);
+            pending.push_back(input);
+            break;
+        }
+        
+        case EI_EVENT_SCROLL_STOP:
+        case EI_EVENT_SCROLL_CANCEL: {
+            InputEvent input = make_input_event(InputEventType::ScrollStop, 0, time);
+            input.u[0] = ei_event_scroll_get_stop_x(event);
+            input.u[1] = ei_event_scroll_get_stop_y(event);
             
-            pointer->send_axis_discrete(time, dx, dy);
-            pointer->send_frame();
+            LOG_TRACE("EI: Scroll stop x=" << input.u[0] << " y=" << input.u[1]);
+            pending.push_back(input);
             break;
         }
         
         default:
-            std::cout << "EI: Unhandled pointer event type: " << type << std::endl;
+            LOG_DEBUG("EI: Unhandled pointer event type: " << type);
             break;
     }
-} 
\ No newline at end of file
+}
+
+uint32_t LibEIHandler::event_time(struct ei_event* event) {
+    // The frame's timestamp, on our clock; the wakeup time if it has none
+    uint64_t received = event_loop ? event_loop->wakeup_time_ns() : LatencyTracker::now_ns();
+    return wayland_time(clock.map(ei_event_get_time(event), received));
+}
@@ -4,34 +4,60 @@ extern "C" {
 #include <libei.h>
 }
 
-class WaylandVirtualKeyboard;
-class WaylandVirtualPointer;
+#include <functional>
+#include <vector>
+#include "client_clock.h"
+#include "input_event.h"
+
+class EventLoop;
+class OutputLayout;
 
 class LibEIHandler {
 public:
+    // Receives the input of one dispatch() at a time
+    using InputSink = std::function<void(const std::vector<InputEvent>&)>;
+    
     LibEIHandler();
     ~LibEIHandler();
     
-    bool init(WaylandVirtualKeyboard* kb, WaylandVirtualPointer* ptr);
+    bool init();
     void cleanup();
-    void run();
-    void stop();
-    bool is_running() const { return running; }
+    // Register the EI file descriptor with the event loop
+    bool attach(EventLoop& loop);
+    void dispatch();
+    
+    // Where translated input goes; the portal sends it on a session of its
+    // own, so it waits for a stalled compositor like every other frontend's
+    void set_input_sink(InputSink sink) { input_sink = std::move(sink); }
+    // Stop or resume reading the EI fd, while the sink's queue is full
+    void set_reading(bool enabled);
+    // Monitor geometry that absolute positions are mapped onto
+    void set_output_layout(const OutputLayout* layout) { outputs = layout; }
     
     // Public access to ei_context for portal integration
     struct ei* ei_context;
     
-    // Public access to virtual input devices for portal integration
-    WaylandVirtualKeyboard* keyboard;
-    WaylandVirtualPointer* pointer;
-    
     // Public event handling for portal integration
     void handle_event(struct ei_event* event);
     void handle_keyboard_event(struct ei_event* event);
     void handle_pointer_event(struct ei_event* event);
     
+    // Events that never reached the sink (no output geometry known)
+    uint64_t dropped_count() const { return dropped; }
+    
 private:
     struct ei_seat* seat;
+    EventLoop* event_loop;
+    
+    InputSink input_sink;
+    // Input of the current dispatch(); keeps its capacity between dispatches
+    std::vector<InputEvent> pending;
+    
+    uint64_t dropped = 0;
+    
+    // Wayland time for an event from the client's frame timestamp
+    ClientClock clock;
+    uint32_t event_time(struct ei_event* event);
     
-    bool running;
+    const OutputLayout* outputs = nullptr;
 }; 
\ No newline at end of file
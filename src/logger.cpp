@@ -0,0 +1,162 @@
+#include "logger.h"
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <pthread.h>
+
+namespace {
+
+// Bounded multi-producer ring buffer (Vyukov); the drain thread is the only consumer
+class LogRing {
+public:
+    static constexpr size_t size = 1024;
+    
+    bool push(const LogRecord& record) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos % size];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->record = record;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    
+    bool pop(LogRecord& record) {
+        Cell* cell = &cells[dequeue_pos % size];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(dequeue_pos + 1) < 0) {
+            return false; // empty
+        }
+        record = cell->record;
+        cell->sequence.store(dequeue_pos + size, std::memory_order_release);
+        dequeue_pos++;
+        return true;
+    }
+    
+    LogRing() {
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LogRecord record{LogLevel::Info};
+    };
+    
+    Cell cells[size];
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) size_t dequeue_pos = 0;
+};
+
+std::unique_ptr<LogRing> ring;
+std::thread drain_thread;
+std::atomic<bool> active{false};
+// Bumped on every push so the drain thread can sleep in atomic::wait()
+std::atomic<uint32_t> pushed{0};
+std::atomic<uint64_t> dropped_count{0};
+
+void write_record(const LogRecord& record) {
+    FILE* out = record.level >= LogLevel::Warn ? stderr : stdout;
+    fwrite(record.text, 1, record.length, out);
+    fputc('\n', out);
+}
+
+void drain_loop() {
+    // Named so per-thread CPU time in the metrics can tell it apart
+    pthread_setname_np(pthread_self(), "hypr-remote-log");
+    LogRecord record(LogLevel::Info);
+    uint64_t reported_drops = 0;
+    
+    for (;;) {
+        uint32_t seen = pushed.load(std::memory_order_acquire);
+        
+        bool wrote = false;
+        while (ring->pop(record)) {
+            write_record(record);
+            wrote = true;
+        }
+        
+        uint64_t drops = dropped_count.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            fprintf(stderr, "Logger: %llu records dropped\n",
+                    static_cast<unsigned long long>(drops - reported_drops));
+            reported_drops = drops;
+        }
+        
+        // One flush per batch rather than per line
+        if (wrote) {
+            fflush(stdout);
+            fflush(stderr);
+        }
+        
+        if (!active.load(std::memory_order_acquire)) {
+            // Pick up anything pushed between the last pop and stop()
+            while (ring->pop(record)) {
+                write_record(record);
+            }
+            fflush(stdout);
+            fflush(stderr);
+            return;
+        }
+        
+        pushed.wait(seen, std::memory_order_acquire);
+    }
+}
+
+} // namespace
+
+void Logger::start() {
+    if (active.load()) return;
+    
+    ring = std::make_unique<LogRing>();
+    active.store(true, std::memory_order_release);
+    drain_thread = std::thread(drain_loop);
+}
+
+void Logger::stop() {
+    if (!active.exchange(false)) return;
+    
+    pushed.fetch_add(1, std::memory_order_release);
+    pushed.notify_one();
+    if (drain_thread.joinable()) {
+        drain_thread.join();
+    }
+    ring.reset();
+}
+
+void Logger::submit(const LogRecord& record) {
+    if (!active.load(std::memory_order_acquire)) {
+        write_record(record);
+        fflush(record.level >= LogLevel::Warn ? stderr : stdout);
+        return;
+    }
+    
+    if (!ring->push(record)) {
+        // Never lose warnings and errors; write them directly instead
+        if (record.level >= LogLevel::Warn) {
+            write_record(record);
+            fflush(stderr);
+        } else {
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    pushed.fetch_add(1, std::memory_order_release);
+    pushed.notify_one();
+}
+
+uint64_t Logger::dropped() {
+    return dropped_count.load(std::memory_order_relaxed);
+}
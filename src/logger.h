@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+enum class LogLevel : int {
+    Trace = 0,
+    Debug = 1,
+    Info = 2,
+    Warn = 3,
+    Error = 4,
+};
+
+// Records below this level are compiled out entirely. Release builds (NDEBUG)
+// drop trace logging unless the build overrides it.
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 0
+#endif
+#endif
+
+// One formatted log line in a fixed buffer; formatting never allocates.
+// Text beyond the buffer is truncated.
+class LogRecord {
+public:
+    static constexpr size_t capacity = 240;
+    
+    explicit LogRecord(LogLevel lvl) : level(lvl), length(0) {}
+    
+    LogRecord& operator<<(std::string_view str) {
+        size_t n = std::min(str.size(), capacity - length);
+        for (size_t i = 0; i < n; i++) {
+            text[length + i] = str[i];
+        }
+        length += n;
+        return *this;
+    }
+    LogRecord& operator<<(const char* str) { return *this << std::string_view(str ? str : "(null)"); }
+    LogRecord& operator<<(char c) { return *this << std::string_view(&c, 1); }
+    LogRecord& operator<<(bool b) { return *this << std::string_view(b ? "true" : "false"); }
+    
+    template<typename T>
+        requires(std::integral<T> && !std::same_as<T, bool> && !std::same_as<T, char>)
+    LogRecord& operator<<(T value) {
+        auto [end, ec] = std::to_chars(text + length, text + capacity, value);
+        if (ec == std::errc()) length = end - text;
+        return *this;
+    }
+    
+    template<typename T>
+        requires std::floating_point<T>
+    LogRecord& operator<<(T value) {
+        auto [end, ec] = std::to_chars(text + length, text + capacity, value);
+        if (ec == std::errc()) length = end - text;
+        return *this;
+    }
+    
+    template<typename T>
+        requires std::is_enum_v<T>
+    LogRecord& operator<<(T value) {
+        return *this << static_cast<std::underlying_type_t<T>>(value);
+    }
+    
+    std::string_view view() const { return std::string_view(text, length); }
+    
+    LogLevel level;
+    size_t length;
+    char text[capacity];
+};
+
+// Asynchronous logger: producers format into a LogRecord and push it into a
+// lock-free ring buffer; a background thread writes records out in batches.
+// Until start() is called (and after stop()) records are written synchronously.
+// stop() must only be called once no other thread is logging any more.
+class Logger {
+public:
+    static void start();
+    static void stop();
+    
+    static void set_level(LogLevel lvl) { min_level.store(static_cast<int>(lvl), std::memory_order_relaxed); }
+    static bool enabled(LogLevel lvl) { return static_cast<int>(lvl) >= min_level.load(std::memory_order_relaxed); }
+    
+    static void submit(const LogRecord& record);
+    
+    // Records lost because the ring buffer was full
+    static uint64_t dropped();
+    
+private:
+    static inline std::atomic<int> min_level{static_cast<int>(LogLevel::Info)};
+};
+
+// Level check happens before any formatting; levels below LOG_MIN_LEVEL
+// are discarded at compile time
+#define LOG_AT(lvl, ...)                                                         \
+    do {                                                                         \
+        if constexpr (static_cast<int>(lvl) >= LOG_MIN_LEVEL) {                  \
+            if (Logger::enabled(lvl)) {                                          \
+                LogRecord log_record_(lvl);                                      \
+                log_record_ << __VA_ARGS__;                                      \
+                Logger::submit(log_record_);                                     \
+            }                                                                    \
+        }                                                                        \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
@@ -1,135 +1,217 @@
 #include "portal.h"
-#include "wayland_virtual_keyboard.h"
-#include "wayland_virtual_pointer.h"
+#include "wayland_connection.h"
 #include "libei_handler.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "latency_stats.h"
+#include "input_capture.h"
+#include "thread_scheduling.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
-#include <thread>
 #include <signal.h>
-#include <chrono>
-
-static bool running = true;
-
-void signal_handler(int signal) {
-    std::cout << "\nReceived signal " << signal << ", shutting down..." << std::endl;
-    running = false;
-}
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 int main(int argc, char* argv[]) {
+    // Cold start is measured from here to the first CreateSession answered
+    uint64_t start_ns = LatencyTracker::now_ns();
+    
     // Parse command line arguments
-    bool verbose = false;
+    LogLevel log_level = LogLevel::Info;
+    size_t max_queued = 1024;
+    std::string capture_path;
+    ThreadScheduling scheduling;
+    unsigned long idle_exit_seconds = 0;
+    bool resample_motion = false;
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--verbose" || arg == "-v") {
-            verbose = true;
+            log_level = LogLevel::Debug;
+        } else if (arg == "--trace") {
+            log_level = LogLevel::Trace;
+        } else if (arg == "--max-queued" && i + 1 < argc) {
+            max_queued = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--capture" && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (arg == "--input-cpu" && i + 1 < argc) {
+            scheduling.cpu = std::atoi(argv[++i]);
+        } else if (arg == "--idle-exit" && i + 1 < argc) {
+            idle_exit_seconds = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--resample-motion") {
+            resample_motion = true;
         } else if (arg == "--help" || arg == "-h") {
             std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
             std::cout << "Options:" << std::endl;
             std::cout << "  --verbose, -v    Enable verbose debug output" << std::endl;
+            std::cout << "  --trace          Also log every input event (debug builds only)" << std::endl;
+            std::cout << "  --max-queued N   Input entries a session may queue while the compositor" << std::endl;
+            std::cout << "                   is stalled before its client is paused (default 1024)" << std::endl;
+            std::cout << "  --capture FILE   Record handled input and the requests it became, for input-replay" << std::endl;
+            std::cout << "  --input-cpu N    Pin the event loop thread, which forwards input, to CPU N" << std::endl;
+            std::cout << "  --idle-exit SECONDS  Exit after this long without sessions; D-Bus activation" << std::endl;
+            std::cout << "                   starts the portal again on the next call (default 0, never)" << std::endl;
+            std::cout << "  --resample-motion  Send pointer motion once per output refresh instead of with" << std::endl;
+            std::cout << "                   every client frame; buttons and keys are not delayed" << std::endl;
             std::cout << "  --help, -h       Show this help message" << std::endl;
             return 0;
         }
     }
     
-    // Set up signal handling
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    // Log records are written by a background thread from here on; the guard
+    // drains and joins it on every return path
+    Logger::set_level(log_level);
+    Logger::start();
+    struct LoggerGuard { ~LoggerGuard() { Logger::stop(); } } logger_guard;
+    
+    // Deliver SIGINT/SIGTERM through a signalfd so shutdown is just another
+    // event in the loop
+    sigset_t signal_mask;
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGINT);
+    sigaddset(&signal_mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signal_mask, nullptr);
+    int signal_fd = signalfd(-1, &signal_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (signal_fd < 0) {
+        LOG_ERROR("Failed to create signalfd");
+        return 1;
+    }
     
-    std::cout << "Hyprland Remote Desktop Portal starting..." << std::endl;
-    if (verbose) {
-        std::cout << "[VERBOSE MODE ENABLED]" << std::endl;
+    LOG_INFO("Hyprland Remote Desktop Portal starting...");
+    if (log_level < LogLevel::Info) {
+        LOG_INFO("[VERBOSE MODE ENABLED]");
     }
     
     // Initialize components
-    WaylandVirtualKeyboard waylandVK;
-    WaylandVirtualPointer waylandVP;
+    LatencyTracker latency;
+    InputCapture capture;
+    EventLoop loop;
+    WaylandConnection waylandConn;
     LibEIHandler libeiHandler;
     Portal portal;
     
-    // Initialize Wayland virtual keyboard
-    if (!waylandVK.init()) {
-        std::cerr << "Failed to initialize Wayland virtual keyboard" << std::endl;
+    if (!loop.init()) {
+        LOG_ERROR("Failed to initialize event loop");
+        close(signal_fd);
         return 1;
     }
-    std::cout << "✓ Virtual keyboard initialized" << std::endl;
     
-    // Initialize Wayland virtual pointer
-    if (!waylandVP.init()) {
-        std::cerr << "Failed to initialize Wayland virtual pointer" << std::endl;
-        waylandVK.cleanup();
+    loop.add_fd(signal_fd, EPOLLIN, [&loop, signal_fd](uint32_t) {
+        struct signalfd_siginfo info;
+        if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+            LOG_INFO("\nReceived signal " << info.ssi_signo << ", shutting down...");
+            loop.stop();
+        }
+    });
+    
+    // Connect to the compositor once; every session's virtual devices share it
+    if (!waylandConn.init()) {
+        LOG_ERROR("Failed to connect to Wayland compositor");
         return 1;
     }
-    std::cout << "✓ Virtual pointer initialized" << std::endl;
     
-    // Initialize libei handler
-    if (!libeiHandler.init(&waylandVK, &waylandVP)) {
-        std::cerr << "Failed to initialize LibEI handler" << std::endl;
-        waylandVP.cleanup();
-        waylandVK.cleanup();
+    // Initialize libei handler; its input goes out on a portal session
+    if (!libeiHandler.init()) {
+        LOG_ERROR("Failed to initialize LibEI handler");
+        waylandConn.cleanup();
         return 1;
     }
-    std::cout << "✓ LibEI handler initialized" << std::endl;
-    
-    // Start LibEI handler in background thread
-    std::thread libei_thread([&libeiHandler]() {
-        libeiHandler.run();
-    });
-    
-    std::cout << "✓ LibEI handler started and ready for connections" << std::endl;
-    
-    // Set verbose mode
-    portal.setVerbose(verbose);
+    LOG_INFO("✓ LibEI handler initialized");
     
     // Initialize portal
-    if (!portal.init(&libeiHandler)) {
-        std::cerr << "Failed to initialize D-Bus portal" << std::endl;
-        libeiHandler.stop();
-
-        if (libei_thread.joinable()) {
-            libei_thread.join();
-        }
-
+    if (!portal.init(&libeiHandler, &waylandConn)) {
+        LOG_ERROR("Failed to initialize D-Bus portal");
         libeiHandler.cleanup();
-        waylandVP.cleanup();
-        waylandVK.cleanup();
-        std::cerr << "Exiting..." << std::endl;
+        waylandConn.cleanup();
+        LOG_ERROR("Exiting...");
 
         return 1;
     }
-    std::cout << "✓ D-Bus portal initialized" << std::endl;
-    
-    std::cout << "\n🚀 Hyprland Remote Desktop Portal is ready!" << std::endl;
-    std::cout << "Portal available at: org.freedesktop.impl.portal.desktop.hypr-remote" << std::endl;
-    std::cout << "Press Ctrl+C to stop." << std::endl;
-    
-    // Start portal in separate thread
-    std::thread portal_thread([&portal]() {
-        portal.run();
-    });
+    LOG_INFO("✓ D-Bus portal initialized");
+    
+    // Stamp every forwarded event on its way from socket to compositor
+    waylandConn.set_latency_tracker(&latency);
+    libeiHandler.set_output_layout(&waylandConn.get_outputs());
+    portal.set_latency_tracker(&latency);
+    portal.set_max_queued(std::max<size_t>(max_queued, 1));
+    portal.set_start_time(start_ns);
+    portal.set_motion_resampling(resample_motion);
+    if (!capture_path.empty() && capture.open(capture_path)) {
+        waylandConn.set_capture(&capture);
+        portal.set_capture(&capture);
+        // Written out whenever the loop is about to sleep, so an idle daemon
+        // has nothing buffered
+        loop.add_prepare_hook([&capture]() {
+            capture.flush();
+            return -1;
+        });
+    }
     
-    // Main loop - just wait for shutdown signal
-    while (running) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Everything runs from one epoll loop: D-Bus, EIS, EI and the Wayland display
+    if (!waylandConn.attach(loop) || !libeiHandler.attach(loop) || !portal.attach(loop)) {
+        LOG_ERROR("Failed to register with event loop");
+        portal.cleanup();
+        libeiHandler.cleanup();
+        waylandConn.cleanup();
+        return 1;
+    }
+    LOG_INFO("✓ LibEI handler started and ready for connections");
+    
+    // Only CPU affinity: the loop thread forwards input but also serves
+    // D-Bus, so its scheduling policy stays normal. The logger thread is
+    // already running and isn't pinned with it.
+    apply_thread_scheduling(scheduling);
+    std::string scheduling_report = describe_thread_scheduling();
+    LOG_INFO("Input thread scheduling: " << scheduling_report);
+    portal.set_input_scheduling(scheduling_report);
+    
+    if (idle_exit_seconds > 0) {
+        // Remote control is occasional; don't hold the compositor connection
+        // and the memory behind it while nobody uses it
+        // Capped well short of overflowing the nanosecond count (about a century)
+        uint64_t idle_exit_ns = std::min<uint64_t>(idle_exit_seconds, 3153600000ull) * 1000000000ull;
+        uint64_t idle_since = LatencyTracker::now_ns();
+        loop.add_prepare_hook([&loop, &portal, idle_exit_ns, idle_since]() mutable {
+            uint64_t now = LatencyTracker::now_ns();
+            if (!portal.idle()) {
+                idle_since = now;
+                return -1;
+            }
+            if (now - idle_since >= idle_exit_ns) {
+                LOG_INFO("💤 No sessions for " << idle_exit_ns / 1000000000ull << " s, exiting until activated again");
+                portal.release_name();
+                loop.stop();
+                return 0;
+            }
+            // Round up, so the wakeup doesn't land just short of the deadline.
+            // Long timeouts are checked again after INT_MAX ms; a negative
+            // value would make epoll wait forever.
+            uint64_t remaining_ms = (idle_exit_ns - (now - idle_since) + 999999) / 1000000;
+            return static_cast<int>(std::min<uint64_t>(remaining_ms, INT_MAX));
+        });
     }
     
-    std::cout << "\nShutting down components..." << std::endl;
+    LOG_INFO("\n🚀 Hyprland Remote Desktop Portal is ready!");
+    LOG_INFO("Portal available at: org.freedesktop.impl.portal.desktop.hypr-remote");
+    LOG_INFO("Press Ctrl+C to stop.");
+    LOG_INFO("⏱️ Ready " << (LatencyTracker::now_ns() - start_ns) / 1000 << " us after process start");
     
-    // Stop and cleanup
-    portal.stop();
-    if (portal_thread.joinable()) {
-        portal_thread.join();
-    }
+    // Sleep until a fd becomes ready; returns once a signal stops the loop
+    loop.run();
     
-    libeiHandler.stop();
-    if (libei_thread.joinable()) {
-        libei_thread.join();
-    }
+    LOG_INFO("\nShutting down components...");
     
     // Cleanup in reverse order
     portal.cleanup();
+    waylandConn.set_capture(nullptr);
+    capture.close();
     libeiHandler.cleanup();
-    waylandVP.cleanup();
-    waylandVK.cleanup();
+    waylandConn.cleanup();
+    loop.cleanup();
+    close(signal_fd);
     
-    std::cout << "✓ Shutdown complete" << std::endl;
+    LOG_INFO("✓ Shutdown complete");
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "metrics.h"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+static void append_escaped(std::string& out, const std::string& value) {
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default: out += c; break;
+        }
+    }
+}
+
+static void append_value(std::string& out, double value) {
+    if (std::isnan(value)) {
+        out += "NaN";
+        return;
+    }
+    char buffer[32];
+    // Counters are integral; print them without an exponent
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<long long>(value));
+        out.append(buffer, end);
+    } else {
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, end);
+    }
+}
+
+void MetricsWriter::family(const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void MetricsWriter::sample(const std::string& name, double value, Labels labels) {
+    out += name;
+    if (labels.size() > 0) {
+        out += '{';
+        bool first = true;
+        for (const auto& [label, label_value] : labels) {
+            if (!first) out += ',';
+            first = false;
+            out += label;
+            out += "=\"";
+            append_escaped(out, label_value);
+            out += '"';
+        }
+        out += '}';
+    }
+    out += ' ';
+    append_value(out, value);
+    out += '\n';
+}
+
+std::vector<ThreadCpuTime> read_thread_cpu_times() {
+    std::vector<ThreadCpuTime> threads;
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks) {
+        return threads;
+    }
+    double ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+
+    while (struct dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] == '.') continue;
+        std::ifstream stat(std::string("/proc/self/task/") + entry->d_name + "/stat");
+        std::string line;
+        if (!std::getline(stat, line)) continue;
+
+        // "tid (comm) state ..."; comm may contain spaces and parentheses,
+        // so split on the last ')'
+        size_t open = line.find('(');
+        size_t close = line.rfind(')');
+        if (open == std::string::npos || close == std::string::npos || close < open) continue;
+
+        ThreadCpuTime thread;
+        thread.tid = static_cast<pid_t>(std::atol(entry->d_name));
+        thread.name = line.substr(open + 1, close - open - 1);
+
+        // Fields 14 and 15, utime and stime, are the 12th and 13th after comm
+        std::istringstream fields(line.substr(close + 1));
+        std::string field;
+        unsigned long long utime = 0, stime = 0;
+        for (int i = 0; i < 13 && fields >> field; i++) {
+            if (i == 11) utime = std::strtoull(field.c_str(), nullptr, 10);
+            if (i == 12) stime = std::strtoull(field.c_str(), nullptr, 10);
+        }
+        thread.user_seconds = utime / ticks;
+        thread.system_seconds = stime / ticks;
+        threads.push_back(std::move(thread));
+    }
+    closedir(tasks);
+    return threads;
+}
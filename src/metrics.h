@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+// Builds a Prometheus text exposition (version 0.0.4): one HELP/TYPE header
+// per family followed by its samples. Scrapers and `busctl` alike can read it.
+class MetricsWriter {
+public:
+    using Labels = std::initializer_list<std::pair<const char*, std::string>>;
+
+    // type is "counter", "gauge" or "summary"
+    void family(const char* name, const char* type, const char* help);
+    void sample(const std::string& name, double value, Labels labels = {});
+
+    const std::string& text() const { return out; }
+
+private:
+    std::string out;
+};
+
+// CPU time a thread of this process has used so far
+struct ThreadCpuTime {
+    pid_t tid;
+    std::string name;   // comm, as set with pthread_setname_np
+    double user_seconds;
+    double system_seconds;
+};
+
+// Every thread of the process, from /proc/self/task
+std::vector<ThreadCpuTime> read_thread_cpu_times();
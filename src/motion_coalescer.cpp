@@ -0,0 +1,160 @@
+#include "motion_coalescer.h"
+#include "wayland_virtual_pointer.h"
+
+extern "C" {
+#include <wayland-client-protocol.h>
+}
+
+// Pixels one wheel notch scrolls, as wlroots and libinput report it
+static constexpr double PIXELS_PER_NOTCH = 15.0;
+
+void MotionCoalescer::add_motion(double dx, double dy) {
+    if (has_motion) coalesced++;
+    has_motion = true;
+    motion_dx += dx;
+    motion_dy += dy;
+}
+
+void MotionCoalescer::add_motion_absolute(uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent) {
+    // An absolute position supersedes any relative motion queued before it,
+    // so pending state is always "absolute, then relative"
+    if (has_absolute) coalesced++;
+    if (has_motion) {
+        coalesced++;
+        has_motion = false;
+        motion_dx = 0.0;
+        motion_dy = 0.0;
+    }
+    has_absolute = true;
+    absolute_x = x;
+    absolute_y = y;
+    absolute_x_extent = x_extent;
+    absolute_y_extent = y_extent;
+}
+
+void MotionCoalescer::add_scroll(double dx, double dy, bool finger) {
+    if (has_scroll) coalesced++;
+    has_scroll = true;
+    scroll_finger = finger;
+    scroll_axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL].value += dx;
+    scroll_axes[WL_POINTER_AXIS_VERTICAL_SCROLL].value += dy;
+}
+
+void MotionCoalescer::add_scroll_discrete(int32_t dx120, int32_t dy120) {
+    if (has_discrete) coalesced++;
+    has_discrete = true;
+    scroll_axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL].value120 += dx120;
+    scroll_axes[WL_POINTER_AXIS_VERTICAL_SCROLL].value120 += dy120;
+}
+
+void MotionCoalescer::add_scroll_stop(bool x, bool y) {
+    if (!x && !y) return;
+    has_stop = true;
+    scroll_axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL].stop |= x;
+    scroll_axes[WL_POINTER_AXIS_VERTICAL_SCROLL].stop |= y;
+}
+
+void MotionCoalescer::merge(const MotionCoalescer& later) {
+    const ScrollAxis& h = later.scroll_axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL];
+    const ScrollAxis& v = later.scroll_axes[WL_POINTER_AXIS_VERTICAL_SCROLL];
+    if (later.has_absolute) {
+        add_motion_absolute(later.absolute_x, later.absolute_y,
+                            later.absolute_x_extent, later.absolute_y_extent);
+    }
+    if (later.has_motion) {
+        add_motion(later.motion_dx, later.motion_dy);
+    }
+    if (later.has_scroll) {
+        add_scroll(h.value, v.value, later.scroll_finger);
+    }
+    if (later.has_discrete) {
+        add_scroll_discrete(h.value120, v.value120);
+    }
+    add_scroll_stop(h.stop, v.stop);
+    coalesced += later.coalesced;
+}
+
+bool MotionCoalescer::flush_to(WaylandVirtualPointer* pointer, uint32_t time) {
+    if (empty() || !pointer) return false;
+    
+    bool sent = false;
+    if (has_absolute) {
+        pointer->send_motion_absolute(time, absolute_x, absolute_y, absolute_x_extent, absolute_y_extent);
+        sent = true;
+    }
+    
+    if (has_motion) {
+        // wl_fixed_t has 1/256 precision; keep what it can't represent for next time
+        double dx = motion_dx + remainder_dx;
+        double dy = motion_dy + remainder_dy;
+        wl_fixed_t fx = wl_fixed_from_double(dx);
+        wl_fixed_t fy = wl_fixed_from_double(dy);
+        remainder_dx = dx - wl_fixed_to_double(fx);
+        remainder_dy = dy - wl_fixed_to_double(fy);
+        if (fx != 0 || fy != 0) {
+            pointer->send_motion(time, wl_fixed_to_double(fx), wl_fixed_to_double(fy));
+            sent = true;
+        }
+    }
+    
+    if (has_scroll || has_discrete || has_stop) {
+        AxisRequests vertical = take_scroll_axis(WL_POINTER_AXIS_VERTICAL_SCROLL);
+        AxisRequests horizontal = take_scroll_axis(WL_POINTER_AXIS_HORIZONTAL_SCROLL);
+        // The carry can swallow a whole frame's scroll; a source without an
+        // axis event after it would be left dangling
+        if (!vertical.empty() || !horizontal.empty()) {
+            // One source per frame: a wheel if any notches moved, otherwise
+            // whatever sent the smooth deltas
+            uint32_t source = has_discrete ? WL_POINTER_AXIS_SOURCE_WHEEL
+                            : scroll_finger ? WL_POINTER_AXIS_SOURCE_FINGER
+                            : WL_POINTER_AXIS_SOURCE_CONTINUOUS;
+            pointer->send_axis_source(source);
+            send_scroll_axis(pointer, time, WL_POINTER_AXIS_VERTICAL_SCROLL, vertical);
+            send_scroll_axis(pointer, time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, horizontal);
+            sent = true;
+        }
+    }
+    
+    has_motion = has_absolute = has_scroll = has_discrete = has_stop = false;
+    motion_dx = motion_dy = 0.0;
+    return sent;
+}
+
+MotionCoalescer::AxisRequests MotionCoalescer::take_scroll_axis(uint32_t axis) {
+    ScrollAxis& a = scroll_axes[axis];
+    AxisRequests requests;
+    
+    // Wheel movement scrolls by its share of a notch right away; the discrete
+    // step count only advances once whole notches have accumulated
+    double value = a.value + a.value120 * PIXELS_PER_NOTCH / 120.0 + a.value_remainder;
+    requests.value = wl_fixed_from_double(value);
+    a.value_remainder = value - wl_fixed_to_double(requests.value);
+    
+    int32_t value120 = a.value120 + a.value120_remainder;
+    requests.steps = value120 / 120;
+    a.value120_remainder = value120 - requests.steps * 120;
+    
+    if (a.stop) {
+        // The sequence is over; nothing of it may leak into the next one
+        requests.stop = true;
+        a.value_remainder = 0.0;
+        a.value120_remainder = 0;
+    }
+    
+    a.value = 0.0;
+    a.value120 = 0;
+    a.stop = false;
+    return requests;
+}
+
+void MotionCoalescer::send_scroll_axis(WaylandVirtualPointer* pointer, uint32_t time, uint32_t axis,
+                                       const AxisRequests& requests) {
+    if (requests.steps != 0) {
+        pointer->send_axis_discrete(time, axis, wl_fixed_to_double(requests.value), requests.steps);
+    } else if (requests.value != 0) {
+        pointer->send_axis(time, axis, wl_fixed_to_double(requests.value));
+    }
+    if (requests.stop) {
+        pointer->send_axis_stop(time, axis);
+    }
+}
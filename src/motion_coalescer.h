@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+
+class WaylandVirtualPointer;
+
+// Accumulates pointer motion and scroll between ordering barriers so a backlog
+// of queued events is replayed as one request per kind instead of one per event.
+class MotionCoalescer {
+public:
+    void add_motion(double dx, double dy);
+    // Position and extents as sent to zwlr_virtual_pointer_v1.motion_absolute
+    void add_motion_absolute(uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent);
+    // Smooth scroll in logical pixels. From a finger on a touchpad unless
+    // finger is false: then it is a continuous source (wl_pointer axis
+    // source "continuous") that never sends a stop, so compositors and
+    // clients don't wait for one to end kinetic scrolling.
+    void add_scroll(double dx, double dy, bool finger = true);
+    // Wheel scroll in 120ths of a notch (value120); high-resolution wheels
+    // send fractions of a notch
+    void add_scroll_discrete(int32_t dx120, int32_t dy120);
+    // The scroll sequence ended on these axes, e.g. the finger was lifted
+    void add_scroll_stop(bool x, bool y);
+    // Add everything another coalescer has pending (not its carry), as if
+    // its events had been added here; this one must have no stop pending
+    void merge(const MotionCoalescer& later);
+    
+    bool empty() const { return !has_motion && !has_absolute && !has_scroll && !has_discrete && !has_stop; }
+    // A stop must reach the compositor before scrolling on that axis resumes
+    bool scroll_stop_pending() const { return has_stop; }
+    
+    // Send everything accumulated so far to the pointer (without a frame):
+    // absolute position first, then relative motion, then scroll.
+    // Returns true if any request was queued; input that only went into the
+    // carry clears the state without sending anything.
+    bool flush_to(WaylandVirtualPointer* pointer, uint32_t time);
+    
+    // Number of input events folded into an earlier one since construction
+    uint64_t coalesced_count() const { return coalesced; }
+    
+private:
+    bool has_motion = false;
+    double motion_dx = 0.0;
+    double motion_dy = 0.0;
+    
+    // Sub-wl_fixed residue of relative motion, carried into the next send
+    double remainder_dx = 0.0;
+    double remainder_dy = 0.0;
+    
+    bool has_absolute = false;
+    uint32_t absolute_x = 0;
+    uint32_t absolute_y = 0;
+    uint32_t absolute_x_extent = 0;
+    uint32_t absolute_y_extent = 0;
+    
+    // Per scroll axis, indexed by wl_pointer axis (vertical, horizontal)
+    struct ScrollAxis {
+        double value = 0.0;         // pixels queued since the last flush
+        int32_t value120 = 0;       // wheel 120ths queued since the last flush
+        bool stop = false;
+        // What the last flush could not send: sub-wl_fixed pixels and
+        // wheel movement short of a whole notch
+        double value_remainder = 0.0;
+        int32_t value120_remainder = 0;
+    };
+    ScrollAxis scroll_axes[2];
+    bool has_scroll = false;
+    bool has_discrete = false;
+    bool has_stop = false;
+    // Source of the newest smooth scroll
+    bool scroll_finger = true;
+    
+    // The requests one axis needs this flush; taking it moves the carry on
+    struct AxisRequests {
+        int32_t value = 0;          // wl_fixed_t
+        int32_t steps = 0;
+        bool stop = false;
+        bool empty() const { return value == 0 && steps == 0 && !stop; }
+    };
+    AxisRequests take_scroll_axis(uint32_t axis);
+    static void send_scroll_axis(WaylandVirtualPointer* pointer, uint32_t time, uint32_t axis,
+                                 const AxisRequests& requests);
+    
+    uint64_t coalesced = 0;
+};
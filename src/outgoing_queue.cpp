@@ -0,0 +1,52 @@
+#include "outgoing_queue.h"
+
+MotionCoalescer& OutgoingQueue::motion(uint32_t time) {
+    if (!pointer_open) {
+        push_pointer();
+    }
+    entries.back().time = time;
+    return entries.back().motion;
+}
+
+void OutgoingQueue::push_pointer() {
+    push(Entry::Type::Pointer);
+    pointer_open = true;
+}
+
+void OutgoingQueue::push_button(uint32_t time, uint32_t button, uint32_t state) {
+    Entry& entry = push(Entry::Type::Button);
+    entry.time = time;
+    entry.args[0] = button;
+    entry.args[1] = state;
+}
+
+void OutgoingQueue::push_key(uint32_t time, uint32_t key, uint32_t state) {
+    Entry& entry = push(Entry::Type::Key);
+    entry.time = time;
+    entry.args[0] = key;
+    entry.args[1] = state;
+}
+
+void OutgoingQueue::push_modifiers(uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group) {
+    Entry& entry = push(Entry::Type::Modifiers);
+    entry.args[0] = depressed;
+    entry.args[1] = latched;
+    entry.args[2] = locked;
+    entry.args[3] = group;
+}
+
+void OutgoingQueue::pop() {
+    entries.pop_front();
+    if (entries.empty()) {
+        pointer_open = false;
+    }
+}
+
+OutgoingQueue::Entry& OutgoingQueue::push(Entry::Type type) {
+    // Anything queued after a pointer entry closes it; later motion must not
+    // jump ahead of the barrier
+    pointer_open = false;
+    Entry& entry = entries.emplace_back();
+    entry.type = type;
+    return entry;
+}
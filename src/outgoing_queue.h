@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include "motion_coalescer.h"
+
+// A session's input held back while the compositor isn't reading from the
+// Wayland socket. Pointer motion and scroll keep merging into the newest
+// pointer entry; keys, buttons and modifier changes queue up behind it in
+// order and are never dropped.
+class OutgoingQueue {
+public:
+    struct Entry {
+        enum class Type {
+            Pointer,    // motion and scroll, in `motion`
+            Button,     // time, button, state
+            Key,        // time, key, state
+            Modifiers   // depressed, latched, locked, group
+        };
+        Type type = Type::Pointer;
+        uint32_t time = 0;
+        uint32_t args[4] = {};
+        MotionCoalescer motion;
+    };
+
+    // Where motion and scroll go while anything is queued: the newest pointer
+    // entry, or a new one if a barrier was queued after it. The entry is sent
+    // with the time of the last input merged into it.
+    MotionCoalescer& motion(uint32_t time);
+    // Start a new pointer entry even if the newest one is still open, e.g.
+    // after a scroll stop that must not merge with the scroll following it
+    void push_pointer();
+    // The pointer entry motion() would merge into, without creating one;
+    // nullptr when the next motion would start a new entry
+    const MotionCoalescer* open_motion() const { return pointer_open ? &entries.back().motion : nullptr; }
+    void push_button(uint32_t time, uint32_t button, uint32_t state);
+    void push_key(uint32_t time, uint32_t key, uint32_t state);
+    void push_modifiers(uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group);
+
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+    Entry& front() { return entries.front(); }
+    void pop();
+
+private:
+    std::deque<Entry> entries;
+    // The newest pointer entry still takes motion
+    bool pointer_open = false;
+
+    Entry& push(Entry::Type type);
+};
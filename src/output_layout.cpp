@@ -0,0 +1,244 @@
+#include "output_layout.h"
+#include "logger.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+struct OutputLayout::Entry {
+    OutputLayout* layout = nullptr;
+    struct wl_output* output = nullptr;
+    struct zxdg_output_v1* xdg_output = nullptr;
+    uint32_t version = 1;
+
+    // What outputs() reports; only valid once ready
+    Output current;
+    bool ready = false;
+
+    // Collected until the next done event
+    Output pending;
+    int32_t geometry_x = 0;
+    int32_t geometry_y = 0;
+    int32_t mode_width = 0;
+    int32_t mode_height = 0;
+    int32_t transform = 0;
+    bool has_logical_position = false;
+    bool has_logical_size = false;
+};
+
+const struct wl_output_listener OutputLayout::output_listener = {
+    .geometry = [](void* data, struct wl_output*, int32_t x, int32_t y, int32_t, int32_t,
+                   int32_t, const char*, const char*, int32_t transform) {
+        Entry* entry = static_cast<Entry*>(data);
+        entry->geometry_x = x;
+        entry->geometry_y = y;
+        entry->transform = transform;
+        if (entry->version < 2) entry->layout->commit(*entry);
+    },
+    .mode = [](void* data, struct wl_output*, uint32_t flags, int32_t width, int32_t height, int32_t refresh) {
+        Entry* entry = static_cast<Entry*>(data);
+        if (!(flags & WL_OUTPUT_MODE_CURRENT)) return;
+        entry->mode_width = width;
+        entry->mode_height = height;
+        entry->pending.refresh = refresh;
+        if (entry->version < 2) entry->layout->commit(*entry);
+    },
+    .done = [](void* data, struct wl_output*) {
+        Entry* entry = static_cast<Entry*>(data);
+        entry->layout->commit(*entry);
+    },
+    .scale = [](void* data, struct wl_output*, int32_t factor) {
+        Entry* entry = static_cast<Entry*>(data);
+        entry->pending.scale = std::max(factor, 1);
+    },
+    .name = [](void* data, struct wl_output*, const char* name) {
+        Entry* entry = static_cast<Entry*>(data);
+        entry->pending.name = name;
+    },
+    .description = [](void*, struct wl_output*, const char*) {},
+};
+
+const struct zxdg_output_v1_listener OutputLayout::xdg_output_listener = {
+    .logical_position = [](void* data, struct zxdg_output_v1*, int32_t x, int32_t y) {
+        Entry* entry = static_cast<Entry*>(data);
+        entry->pending.x = x;
+        entry->pending.y = y;
+        entry->has_logical_position = true;
+    },
+    .logical_size = [](void* data, struct zxdg_output_v1*, int32_t width, int32_t height) {
+        Entry* entry = static_cast<Entry*>(data);
+        entry->pending.width = width;
+        entry->pending.height = height;
+        entry->has_logical_size = true;
+    },
+    .done = [](void* data, struct zxdg_output_v1*) {
+        // Deprecated since version 3 in favour of wl_output.done, still sent by older compositors
+        Entry* entry = static_cast<Entry*>(data);
+        entry->layout->commit(*entry);
+    },
+    .name = [](void* data, struct zxdg_output_v1*, const char* name) {
+        Entry* entry = static_cast<Entry*>(data);
+        if (entry->pending.name.empty()) entry->pending.name = name;
+    },
+    .description = [](void*, struct zxdg_output_v1*, const char*) {},
+};
+
+OutputLayout::OutputLayout() {
+}
+
+OutputLayout::~OutputLayout() {
+    cleanup();
+}
+
+void OutputLayout::set_xdg_output_manager(struct zxdg_output_manager_v1* manager) {
+    xdg_output_manager = manager;
+    // Outputs announced before the manager still get their logical geometry
+    for (auto& entry : entries) {
+        create_xdg_output(*entry);
+    }
+}
+
+void OutputLayout::add_output(struct wl_output* output, uint32_t global_name, uint32_t version) {
+    auto entry = std::make_unique<Entry>();
+    entry->layout = this;
+    entry->output = output;
+    entry->version = version;
+    entry->pending.global_name = global_name;
+    wl_output_add_listener(output, &output_listener, entry.get());
+    create_xdg_output(*entry);
+    entries.push_back(std::move(entry));
+}
+
+bool OutputLayout::remove_output(uint32_t global_name) {
+    auto it = std::find_if(entries.begin(), entries.end(), [global_name](const auto& entry) {
+        return entry->pending.global_name == global_name;
+    });
+    if (it == entries.end()) return false;
+
+    bool was_ready = (*it)->ready;
+    LOG_INFO("🖥️ Output removed: " << (*it)->current.name);
+    destroy(**it);
+    entries.erase(it);
+    if (was_ready && change_listener) {
+        change_listener();
+    }
+    return true;
+}
+
+void OutputLayout::cleanup() {
+    for (auto& entry : entries) {
+        destroy(*entry);
+    }
+    entries.clear();
+    if (xdg_output_manager) {
+        zxdg_output_manager_v1_destroy(xdg_output_manager);
+        xdg_output_manager = nullptr;
+    }
+}
+
+std::vector<OutputLayout::Output> OutputLayout::outputs() const {
+    std::vector<Output> result;
+    for (const auto& entry : entries) {
+        if (entry->ready) {
+            result.push_back(entry->current);
+        }
+    }
+    return result;
+}
+
+OutputLayout::Bounds OutputLayout::bounds() const {
+    int32_t min_x = INT32_MAX, min_y = INT32_MAX;
+    int32_t max_x = INT32_MIN, max_y = INT32_MIN;
+    bool any = false;
+    for (const auto& entry : entries) {
+        if (!entry->ready) continue;
+        const Output& out = entry->current;
+        min_x = std::min(min_x, out.x);
+        min_y = std::min(min_y, out.y);
+        max_x = std::max(max_x, out.x + out.width);
+        max_y = std::max(max_y, out.y + out.height);
+        any = true;
+    }
+    if (!any) return Bounds{};
+    return Bounds{min_x, min_y, max_x - min_x, max_y - min_y};
+}
+
+bool OutputLayout::empty() const {
+    return std::none_of(entries.begin(), entries.end(), [](const auto& entry) { return entry->ready; });
+}
+
+int32_t OutputLayout::max_refresh() const {
+    int32_t refresh = 0;
+    for (const auto& entry : entries) {
+        if (entry->ready) {
+            refresh = std::max(refresh, entry->current.refresh);
+        }
+    }
+    return refresh;
+}
+
+bool OutputLayout::to_absolute(double x, double y, uint32_t& abs_x, uint32_t& abs_y,
+                               uint32_t& x_extent, uint32_t& y_extent) const {
+    Bounds box = bounds();
+    if (box.width <= 0 || box.height <= 0) return false;
+
+    x_extent = static_cast<uint32_t>(box.width) * ABSOLUTE_SUBPIXEL;
+    y_extent = static_cast<uint32_t>(box.height) * ABSOLUTE_SUBPIXEL;
+    // The compositor maps [0, extent) onto the layout box; stay inside it
+    long sx = std::clamp(std::lround(x * ABSOLUTE_SUBPIXEL), 0L, static_cast<long>(x_extent - 1));
+    long sy = std::clamp(std::lround(y * ABSOLUTE_SUBPIXEL), 0L, static_cast<long>(y_extent - 1));
+    abs_x = static_cast<uint32_t>(sx);
+    abs_y = static_cast<uint32_t>(sy);
+    return true;
+}
+
+void OutputLayout::create_xdg_output(Entry& entry) {
+    if (!xdg_output_manager || entry.xdg_output) return;
+    entry.xdg_output = zxdg_output_manager_v1_get_xdg_output(xdg_output_manager, entry.output);
+    zxdg_output_v1_add_listener(entry.xdg_output, &xdg_output_listener, &entry);
+}
+
+void OutputLayout::commit(Entry& entry) {
+    Output next = entry.pending;
+    if (!entry.has_logical_position) {
+        next.x = entry.geometry_x;
+        next.y = entry.geometry_y;
+    }
+    if (!entry.has_logical_size) {
+        // Odd transforms (90, 270 and their flipped variants) swap the axes
+        bool rotated = (entry.transform & 1) != 0;
+        int32_t width = rotated ? entry.mode_height : entry.mode_width;
+        int32_t height = rotated ? entry.mode_width : entry.mode_height;
+        next.width = width / next.scale;
+        next.height = height / next.scale;
+    }
+    if (next.width <= 0 || next.height <= 0) return;
+
+    bool changed = !entry.ready ||
+        next.x != entry.current.x || next.y != entry.current.y ||
+        next.width != entry.current.width || next.height != entry.current.height ||
+        next.scale != entry.current.scale || next.name != entry.current.name;
+    entry.current = next;
+    entry.ready = true;
+    if (!changed) return;
+
+    LOG_INFO("🖥️ Output " << next.name << ": " << next.width << "x" << next.height
+             << " at " << next.x << "," << next.y << " scale " << next.scale);
+    if (change_listener) {
+        change_listener();
+    }
+}
+
+void OutputLayout::destroy(Entry& entry) {
+    if (entry.xdg_output) {
+        zxdg_output_v1_destroy(entry.xdg_output);
+        entry.xdg_output = nullptr;
+    }
+    if (entry.output) {
+        if (entry.version >= 3) {
+            wl_output_release(entry.output);
+        } else {
+            wl_output_destroy(entry.output);
+        }
+        entry.output = nullptr;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <wayland-client.h>
+#include "xdg-output-unstable-v1-client-protocol.h"
+}
+
+// Monitor geometry in the compositor's logical (global) coordinate space.
+// Positions and sizes come from zxdg_output_v1 when the compositor has it, so
+// they already account for scale and transform; plain wl_output geometry and
+// mode divided by scale are the fallback.
+class OutputLayout {
+public:
+    struct Output {
+        uint32_t global_name = 0;
+        std::string name;
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t width = 0;
+        int32_t height = 0;
+        int32_t scale = 1;
+        int32_t refresh = 0;    // current mode, mHz; 0 if not reported
+    };
+
+    // Smallest box around every output, in logical pixels
+    struct Bounds {
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t width = 0;
+        int32_t height = 0;
+    };
+
+    // Absolute motion is sent with extents this many times the layout size,
+    // so positions keep the same 1/256 pixel precision as wl_fixed_t
+    static constexpr uint32_t ABSOLUTE_SUBPIXEL = 256;
+
+    using ChangeListener = std::function<void()>;
+
+    OutputLayout();
+    ~OutputLayout();
+
+    OutputLayout(const OutputLayout&) = delete;
+    OutputLayout& operator=(const OutputLayout&) = delete;
+
+    // Registry hooks, called by WaylandConnection
+    void set_xdg_output_manager(struct zxdg_output_manager_v1* manager);
+    void add_output(struct wl_output* output, uint32_t global_name, uint32_t version);
+    bool remove_output(uint32_t global_name);
+    void cleanup();
+
+    // Called after outputs were added, removed, moved or resized
+    void set_change_listener(ChangeListener listener) { change_listener = std::move(listener); }
+
+    // Outputs the compositor has fully described so far
+    std::vector<Output> outputs() const;
+    Bounds bounds() const;
+    bool empty() const;
+    // Refresh rate of the fastest output in mHz, 0 while none is known
+    int32_t max_refresh() const;
+
+    // Map a position given relative to the top-left corner of bounds() (the
+    // space EIS regions are advertised in) to virtual pointer absolute motion
+    // arguments. Returns false while no output is known.
+    bool to_absolute(double x, double y, uint32_t& abs_x, uint32_t& abs_y,
+                     uint32_t& x_extent, uint32_t& y_extent) const;
+
+private:
+    struct Entry;
+    std::vector<std::unique_ptr<Entry>> entries;
+    struct zxdg_output_manager_v1* xdg_output_manager = nullptr;
+    ChangeListener change_listener;
+
+    void create_xdg_output(Entry& entry);
+    void commit(Entry& entry);
+    void destroy(Entry& entry);
+
+    static const struct wl_output_listener output_listener;
+    static const struct zxdg_output_v1_listener xdg_output_listener;
+};
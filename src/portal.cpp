@@ -1,18 +1,20 @@
 #include "portal.h"
 #include "libei_handler.h"
+#include "wayland_connection.h"
 #include "wayland_virtual_keyboard.h"
 #include "wayland_virtual_pointer.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "latency_stats.h"
+#include "input_capture.h"
+#include "input_event.h"
+#include "metrics.h"
 #include <iostream>
-#include <thread>
-#include <chrono>
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
 #include <unistd.h>
-#include <sys/select.h>
-#include <sys/socket.h>
-#include <sys/un.h>
-#include <poll.h>
-#include <algorithm>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <xkbcommon/xkbcommon.h>
 #include <fcntl.h>
@@ -25,26 +27,55 @@ extern "C" {
 
 static const char* PORTAL_INTERFACE = "org.freedesktop.impl.portal.RemoteDesktop";
 static const char* PORTAL_PATH = "/org/freedesktop/portal/desktop";
+// Portal-specific diagnostics, served next to the RemoteDesktop interface
+static const char* SESSION_INTERFACE = "org.freedesktop.impl.portal.Session";
+static const char* STATS_INTERFACE = "org.freedesktop.impl.portal.desktop.hypr_remote.Stats";
+static const char* INPUT_INTERFACE = "org.freedesktop.impl.portal.desktop.hypr_remote.Input";
 
 // Use development name if requested, otherwise use standard name
 static const char* PORTAL_NAME = "org.freedesktop.impl.portal.desktop.hypr-remote";
 
-Portal::Portal() : libei_handler(nullptr), running(false), verbose(false) {
+// Events that carry the time of the client frame they belong to
+static bool is_input_event(enum eis_event_type type) {
+    switch (type) {
+        case EIS_EVENT_POINTER_MOTION:
+        case EIS_EVENT_POINTER_MOTION_ABSOLUTE:
+        case EIS_EVENT_BUTTON_BUTTON:
+        case EIS_EVENT_SCROLL_DELTA:
+        case EIS_EVENT_SCROLL_DISCRETE:
+        case EIS_EVENT_SCROLL_STOP:
+        case EIS_EVENT_SCROLL_CANCEL:
+        case EIS_EVENT_KEYBOARD_KEY:
+        case EIS_EVENT_FRAME:
+            return true;
+        default:
+            return false;
+    }
 }
 
-Portal::~Portal() {
-    cleanup();
+Portal::Portal() : libei_handler(nullptr), wayland(nullptr), event_loop(nullptr) {
 }
 
-void Portal::setVerbose(bool v) {
-    verbose = v;
-    if (verbose) {
-        std::cout << "🔍 Verbose debugging enabled for Portal" << std::endl;
-    }
+Portal::~Portal() {
+    cleanup();
 }
 
-bool Portal::init(LibEIHandler* handler) {
+bool Portal::init(LibEIHandler* handler, WaylandConnection* conn) {
     libei_handler = handler;
+    wayland = conn;
+    if (wayland) {
+        wayland->get_outputs().set_change_listener([this]() { update_eis_regions(); });
+        wayland->get_keymap().set_change_listener([this]() { update_keymap(); });
+        wayland->set_writable_listener([this]() { drain_outgoing(); });
+    }
+    if (libei_handler) {
+        libei_session = std::make_unique<Session>("ei", "", wayland);
+        libei_handler->set_input_sink([this](const std::vector<InputEvent>& events) { submit_libei_input(events); });
+    }
+    
+    if (!setup_keymap()) {
+        return false;
+    }
     
     try {
         // Create D-Bus connection to SESSION bus (not system bus)
@@ -55,30 +86,37 @@ bool Portal::init(LibEIHandler* handler) {
         
         // Create the portal object
         object = sdbus::createObject(*connection, sdbus::ObjectPath{PORTAL_PATH});
-        std::cout << "Portal D-Bus interface registered at " << PORTAL_NAME << std::endl;
-        std::cout << "Portal registered on SESSION bus (not system bus)" << std::endl;
-        std::cout << "Portal version: 2" << std::endl;
-        std::cout << "Portal path: " << PORTAL_PATH << std::endl;
-        std::cout << "Portal interface: " << PORTAL_INTERFACE << std::endl;
+        LOG_INFO("Portal D-Bus interface registered at " << PORTAL_NAME);
+        LOG_INFO("Portal registered on SESSION bus (not system bus)");
+        LOG_INFO("Portal version: 2");
+        LOG_INFO("Portal path: " << PORTAL_PATH);
+        LOG_INFO("Portal interface: " << PORTAL_INTERFACE);
 
         // Register RemoteDesktop interface methods with correct signatures using new VTable API
         auto createSession = sdbus::registerMethod("CreateSession");
         createSession.inputSignature = "oosa{sv}";
         createSession.outputSignature = "ua{sv}";
         createSession.implementedAs([this](sdbus::ObjectPath req, sdbus::ObjectPath sess, std::string app, std::map<std::string, sdbus::Variant> opts) {
-            std::cout << "🔥 RemoteDesktop CreateSession called!" << std::endl;
-            if (verbose) {
-                std::cout << "  Request handle: " << req << std::endl;
-                std::cout << "  Session handle: " << sess << std::endl;
-                std::cout << "  App ID: " << app << std::endl;
-                std::cout << "  Options: " << opts.size() << " entries" << std::endl;
-                for (const auto& [key, val] : opts) {
-                    std::cout << "    - " << key << std::endl;
-                }
+            LOG_INFO("🔥 RemoteDesktop CreateSession called!");
+            LOG_DEBUG("  Request handle: " << req);
+            LOG_DEBUG("  Session handle: " << sess);
+            LOG_DEBUG("  App ID: " << app);
+            LOG_DEBUG("  Options: " << opts.size() << " entries");
+            for (const auto& [key, val] : opts) {
+                LOG_DEBUG("    - " << key);
             }
+            
+            session_for(sess, app);
+        
             std::map<std::string, sdbus::Variant> response;
             response["session_handle"] = sdbus::Variant(sess);
-            std::cout << "✅ CreateSession completed" << std::endl;
+            LOG_INFO("✅ CreateSession completed");
+            if (start_time_ns) {
+                // How long a D-Bus activated start kept the first caller waiting
+                LOG_INFO("⏱️ First CreateSession answered " << (LatencyTracker::now_ns() - start_time_ns) / 1000
+                         << " us after process start");
+                start_time_ns = 0;
+            }
             return std::make_tuple(static_cast<uint32_t>(0), response);
         });
         
@@ -86,15 +124,20 @@ bool Portal::init(LibEIHandler* handler) {
         selectDevices.inputSignature = "oosa{sv}";
         selectDevices.outputSignature = "ua{sv}";
         selectDevices.implementedAs([this](sdbus::ObjectPath req, sdbus::ObjectPath sess, std::string app, std::map<std::string, sdbus::Variant> opts) {
-            if (verbose) {
-                std::cout << "🔥 RemoteDesktop SelectDevices called!" << std::endl;
-                std::cout << "  Request handle: " << req << std::endl;
-                std::cout << "  Session handle: " << sess << std::endl;
-                std::cout << "  App ID: " << app << std::endl;
-                std::cout << "  Options: " << opts.size() << " entries" << std::endl;
+            LOG_DEBUG("🔥 RemoteDesktop SelectDevices called!");
+            LOG_DEBUG("  Request handle: " << req);
+            LOG_DEBUG("  Session handle: " << sess);
+            LOG_DEBUG("  App ID: " << app);
+            LOG_DEBUG("  Options: " << opts.size() << " entries");
+            Session& session = session_for(sess, app);
+            session.device_types = 7; // keyboard | pointer | touchscreen
+            auto types = opts.find("types");
+            if (types != opts.end() && types->second.containsValueOfType<uint32_t>()) {
+                session.device_types = types->second.get<uint32_t>();
             }
+            session.state = Session::State::DevicesSelected;
             std::map<std::string, sdbus::Variant> response;
-            response["types"] = sdbus::Variant(static_cast<uint32_t>(7)); // keyboard | pointer | touchscreen
+            response["types"] = sdbus::Variant(session.device_types);
             return std::make_tuple(static_cast<uint32_t>(0), response);
         });
         
@@ -102,16 +145,19 @@ bool Portal::init(LibEIHandler* handler) {
         start.inputSignature = "oossa{sv}";
         start.outputSignature = "ua{sv}";
         start.implementedAs([this](sdbus::ObjectPath req, sdbus::ObjectPath sess, std::string app, std::string parent, std::map<std::string, sdbus::Variant> opts) {
-            if (verbose) {
-                std::cout << "🔥 RemoteDesktop Start called!" << std::endl;
-                std::cout << "  Request handle: " << req << std::endl;
-                std::cout << "  Session handle: " << sess << std::endl;
-                std::cout << "  App ID: " << app << std::endl;
-                std::cout << "  Parent window: " << parent << std::endl;
-                std::cout << "  Options: " << opts.size() << " entries" << std::endl;
+            LOG_DEBUG("🔥 RemoteDesktop Start called!");
+            LOG_DEBUG("  Request handle: " << req);
+            LOG_DEBUG("  Session handle: " << sess);
+            LOG_DEBUG("  App ID: " << app);
+            LOG_DEBUG("  Parent window: " << parent);
+            LOG_DEBUG("  Options: " << opts.size() << " entries");
+            Session& session = session_for(sess, app);
+            if (session.device_types == 0) {
+                session.device_types = 7; // keyboard | pointer | touchscreen
             }
+            session.state = Session::State::Started;
             std::map<std::string, sdbus::Variant> response;
-            response["devices"] = sdbus::Variant(static_cast<uint32_t>(7)); // keyboard | pointer | touchscreen
+            response["devices"] = sdbus::Variant(session.device_types);
             return std::make_tuple(static_cast<uint32_t>(0), response);
         });
         
@@ -119,117 +165,65 @@ bool Portal::init(LibEIHandler* handler) {
         notifyPointerMotion.inputSignature = "oa{sv}dd";
         notifyPointerMotion.outputSignature = "";
         notifyPointerMotion.implementedAs([this](sdbus::ObjectPath sess, std::map<std::string, sdbus::Variant> opts, double dx, double dy) {
-            if (verbose) {
-                std::cout << "🖱️ NotifyPointerMotion: dx=" << dx << " dy=" << dy << std::endl;
-            }
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_motion(time, dx, dy);
-                libei_handler->pointer->send_frame();
-            }
+            LOG_DEBUG("🖱️ NotifyPointerMotion: dx=" << dx << " dy=" << dy);
+            notify_pointer_motion(session_for(sess), dx, dy);
         });
         
         auto notifyPointerButton = sdbus::registerMethod("NotifyPointerButton");
         notifyPointerButton.inputSignature = "oa{sv}iu";
         notifyPointerButton.outputSignature = "";
         notifyPointerButton.implementedAs([this](sdbus::ObjectPath sess, std::map<std::string, sdbus::Variant> opts, int32_t button, uint32_t state) {
-            if (verbose) {
-                std::cout << "🖱️ NotifyPointerButton: button=" << button << " state=" << state << std::endl;
-            }
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_button(time, static_cast<uint32_t>(button), state);
-                libei_handler->pointer->send_frame();
-            }
+            LOG_DEBUG("🖱️ NotifyPointerButton: button=" << button << " state=" << state);
+            notify_pointer_button(session_for(sess), static_cast<uint32_t>(button), state);
         });
         
         auto notifyKeyboardKeycode = sdbus::registerMethod("NotifyKeyboardKeycode");
         notifyKeyboardKeycode.inputSignature = "oa{sv}iu";
         notifyKeyboardKeycode.outputSignature = "";
         notifyKeyboardKeycode.implementedAs([this](sdbus::ObjectPath sess, std::map<std::string, sdbus::Variant> opts, int32_t keycode, uint32_t state) {
-            if (verbose) {
-                std::cout << "⌨️ NotifyKeyboardKeycode: keycode=" << keycode << " state=" << state << std::endl;
-            }
-            if (libei_handler && libei_handler->keyboard) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->keyboard->send_key(time, static_cast<uint32_t>(keycode), state);
-            }
+            LOG_DEBUG("⌨️ NotifyKeyboardKeycode: keycode=" << keycode << " state=" << state);
+            notify_keyboard_keycode(session_for(sess), static_cast<uint32_t>(keycode), state);
         });
         
         auto notifyKeyboardKeysym = sdbus::registerMethod("NotifyKeyboardKeysym");
         notifyKeyboardKeysym.inputSignature = "oa{sv}iu";
         notifyKeyboardKeysym.outputSignature = "";
         notifyKeyboardKeysym.implementedAs([this](sdbus::ObjectPath sess, std::map<std::string, sdbus::Variant> opts, int32_t keysym, uint32_t state) {
-            if (verbose) {
-                std::cout << "⌨️ NotifyKeyboardKeysym: keysym=" << keysym << " state=" << state << std::endl;
-            }
-            if (libei_handler && libei_handler->keyboard) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                // Convert XKB keysym to Linux keycode using xkbcommon
-                struct xkb_context *ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-                if (ctx) {
-                    struct xkb_keymap *keymap = xkb_keymap_new_from_names(ctx, nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS);
-                    if (keymap) {
-                        struct xkb_state *xkb_state = xkb_state_new(keymap);
-                        if (xkb_state) {
-                            // Find keycode for keysym
-                            xkb_keycode_t keycode = 0;
-                            const xkb_keycode_t max_keycode = xkb_keymap_max_keycode(keymap);
-                            for (xkb_keycode_t kc = xkb_keymap_min_keycode(keymap); kc < max_keycode; kc++) {
-                                if (xkb_state_key_get_one_sym(xkb_state, kc) == keysym) {
-                                    keycode = kc;
-                                    break;
-                                }
-                            }
-                            if (keycode > 0) {
-                                // XKB keycodes are offset by 8 from Linux keycodes
-                                libei_handler->keyboard->send_key(time, keycode - 8, state);
-                            } else if (verbose) {
-                                std::cout << "  Failed to find keycode for keysym " << keysym << std::endl;
-                            }
-                            xkb_state_unref(xkb_state);
-                        }
-                        xkb_keymap_unref(keymap);
-                    }
-                    xkb_context_unref(ctx);
-                }
-            }
+            LOG_DEBUG("⌨️ NotifyKeyboardKeysym: keysym=" << keysym << " state=" << state);
+            notify_keyboard_keysym(session_for(sess), static_cast<uint32_t>(keysym), state);
         });
         
         auto notifyPointerAxis = sdbus::registerMethod("NotifyPointerAxis");
         notifyPointerAxis.inputSignature = "oa{sv}dd";
         notifyPointerAxis.outputSignature = "";
         notifyPointerAxis.implementedAs([this](sdbus::ObjectPath sess, std::map<std::string, sdbus::Variant> opts, double dx, double dy) {
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
-                if (dx != 0.0) {
-                    libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, dx, dy);
-                    libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL);
-                }
-                if (dy != 0.0) {
-                    libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL, dx, dy);
-                    libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_VERTICAL_SCROLL);
-                }
-                libei_handler->pointer->send_frame();
+            LOG_DEBUG("🖱️ NotifyPointerAxis: dx=" << dx << " dy=" << dy);
+            // Smooth scroll in pixels; "finish" marks the end of the sequence
+            bool finish = false;
+            auto it = opts.find("finish");
+            // Anything but a boolean is ignored rather than failing the call
+            if (it != opts.end() && it->second.containsValueOfType<bool>()) {
+                finish = it->second.get<bool>();
             }
+            notify_pointer_axis(session_for(sess), dx, dy, finish);
+        });
+        
+        auto notifyPointerAxisDiscrete = sdbus::registerMethod("NotifyPointerAxisDiscrete");
+        notifyPointerAxisDiscrete.inputSignature = "oa{sv}ui";
+        notifyPointerAxisDiscrete.outputSignature = "";
+        notifyPointerAxisDiscrete.implementedAs([this](sdbus::ObjectPath sess, std::map<std::string, sdbus::Variant> opts, uint32_t axis, int32_t steps) {
+            LOG_DEBUG("🖱️ NotifyPointerAxisDiscrete: axis=" << axis << " steps=" << steps);
+            notify_pointer_axis_discrete(session_for(sess), axis, steps);
         });
         
         auto connectToEIS = sdbus::registerMethod("ConnectToEIS");
         connectToEIS.inputSignature = "osa{sv}";
         connectToEIS.outputSignature = "h";
         connectToEIS.implementedAs([this](sdbus::ObjectPath sess, std::string app, std::map<std::string, sdbus::Variant> opts) {
-            if (verbose) {
-                std::cout << "🔥 RemoteDesktop ConnectToEIS called!" << std::endl;
-                std::cout << "  Session handle: " << sess << std::endl;
-                std::cout << "  App ID: " << app << std::endl;
-                std::cout << "  Options: " << opts.size() << " entries" << std::endl;
-            }
+            LOG_DEBUG("🔥 RemoteDesktop ConnectToEIS called!");
+            LOG_DEBUG("  Session handle: " << sess);
+            LOG_DEBUG("  App ID: " << app);
+            LOG_DEBUG("  Options: " << opts.size() << " entries");
             return ConnectToEIS(sess, app, opts);
         });
         
@@ -246,24 +240,288 @@ bool Portal::init(LibEIHandler* handler) {
             std::move(notifyKeyboardKeycode),
             std::move(notifyKeyboardKeysym),
             std::move(notifyPointerAxis),
+            std::move(notifyPointerAxisDiscrete),
             std::move(connectToEIS),
             std::move(versionProp)
         );
         
-        std::cout << "Portal D-Bus interface registered at " << PORTAL_NAME << std::endl;
-        std::cout << "Portal registered on SESSION bus (not system bus)" << std::endl;
+        // Many events per call for high-rate clients, applied with one flush;
+        // see BatchEventType for the layout of each (type, code, x, y, state).
+        // Answers how many of the events were forwarded.
+        auto notifyInputBatch = sdbus::registerMethod("NotifyInputBatch");
+        notifyInputBatch.inputSignature = "oa(uuddu)";
+        notifyInputBatch.outputSignature = "u";
+        notifyInputBatch.implementedAs([this](sdbus::ObjectPath sess, std::vector<BatchEvent> events) {
+            LOG_DEBUG("📦 NotifyInputBatch: " << events.size() << " events");
+            return notify_input_batch(session_for(sess), events);
+        });
+        
+        object->addVTable(
+            sdbus::InterfaceName{INPUT_INTERFACE},
+            std::move(notifyInputBatch)
+        );
+        
+        // (session, stage, event kind, count, p50 ns, p99 ns, max ns); an empty
+        // session is the aggregate over all of them
+        auto getLatencyStats = sdbus::registerMethod("GetLatencyStats");
+        getLatencyStats.inputSignature = "";
+        getLatencyStats.outputSignature = "a(ssstttt)";
+        getLatencyStats.implementedAs([this]() {
+            std::vector<sdbus::Struct<std::string, std::string, std::string, uint64_t, uint64_t, uint64_t, uint64_t>> stats;
+            if (latency) {
+                for (const auto& s : latency->summarize()) {
+                    stats.emplace_back(s.session, to_string(s.stage), to_string(s.kind),
+                                       s.count, s.p50_ns, s.p99_ns, s.max_ns);
+                }
+            }
+            return stats;
+        });
+        
+        // Backpressure while the compositor falls behind: how often it stalled
+        // and what that cost, plus the entries queued right now
+        auto getQueueStats = sdbus::registerMethod("GetQueueStats");
+        getQueueStats.inputSignature = "";
+        getQueueStats.outputSignature = "a{st}";
+        getQueueStats.implementedAs([this]() {
+            uint64_t depth = 0;
+            uint64_t coalesced = queue_stats.coalesced;
+            for (const auto& [handle, session] : sessions) {
+                depth += session->outgoing.size();
+                coalesced += session->eis_motion.coalesced_count();
+            }
+            std::map<std::string, uint64_t> stats;
+            stats["stalls"] = wayland ? wayland->stall_count() : 0;
+            stats["queued"] = queue_stats.queued;
+            stats["overflowed"] = queue_stats.overflowed;
+            stats["paused"] = queue_stats.paused;
+            stats["max_depth"] = queue_stats.max_depth;
+            stats["depth"] = depth;
+            stats["coalesced"] = coalesced;
+            // The queue itself never discards; this is input that had nowhere to go
+            stats["dropped"] = input_stats.dropped;
+            return stats;
+        });
+        
+        auto getInputScheduling = sdbus::registerMethod("GetInputScheduling");
+        getInputScheduling.inputSignature = "";
+        getInputScheduling.outputSignature = "s";
+        getInputScheduling.implementedAs([this]() {
+            return input_scheduling;
+        });
+        
+        // Everything above and more, for scraping: Prometheus text format
+        auto getMetrics = sdbus::registerMethod("GetMetrics");
+        getMetrics.inputSignature = "";
+        getMetrics.outputSignature = "s";
+        getMetrics.implementedAs([this]() {
+            return metrics_text();
+        });
+        
+        auto resetLatencyStats = sdbus::registerMethod("ResetLatencyStats");
+        resetLatencyStats.inputSignature = "";
+        resetLatencyStats.outputSignature = "";
+        resetLatencyStats.implementedAs([this]() {
+            if (latency) {
+                latency->reset();
+            }
+        });
+        
+        object->addVTable(
+            sdbus::InterfaceName{STATS_INTERFACE},
+            std::move(getLatencyStats),
+            std::move(getQueueStats),
+            std::move(getInputScheduling),
+            std::move(getMetrics),
+            std::move(resetLatencyStats)
+        );
+        
+        LOG_INFO("Portal D-Bus interface registered at " << PORTAL_NAME);
+        LOG_INFO("Portal registered on SESSION bus (not system bus)");
+        
+        if (!setup_eis()) {
+            cleanup();
+            return false;
+        }
         return true;
         
     } catch (const sdbus::Error& e) {
-        std::cerr << "Failed to initialize D-Bus portal: " << e.what() << std::endl;
-        std::cerr << "This is normal if another portal is already running or if running outside a desktop session." << std::endl;
+        LOG_ERROR("Failed to initialize D-Bus portal: " << e.what());
+        LOG_ERROR("This is normal if another portal is already running or if running outside a desktop session.");
         cleanup();
         return false;
     }
 }
 
+bool Portal::idle() const {
+    return sessions.empty() && closed_sessions.empty() && (!libei_session || libei_session->outgoing.empty());
+}
+
+void Portal::release_name() {
+    if (!connection) return;
+    try {
+        // From here on the bus activates a new instance for portal calls
+        connection->releaseName(sdbus::ServiceName{PORTAL_NAME});
+    } catch (const sdbus::Error& e) {
+        LOG_WARN("Failed to release " << PORTAL_NAME << ": " << e.what());
+    }
+}
+
+std::string Portal::metrics_text() const {
+    MetricsWriter metrics;
+    
+    // Input as the frontends handed it to submit_input(): EIS and D-Bus
+    // sessions, and the libei receiver's own session
+    metrics.family("hypr_remote_input_events_received_total", "counter", "Input events received, by frontend and type");
+    for (size_t i = 0; i < INPUT_EVENT_TYPE_COUNT; i++) {
+        auto type = static_cast<InputEventType>(i);
+        metrics.sample("hypr_remote_input_events_received_total", input_stats.received[i],
+                       {{"frontend", "portal"}, {"type", to_string(type)}});
+        if (libei_session) {
+            metrics.sample("hypr_remote_input_events_received_total", libei_input_stats.received[i],
+                           {{"frontend", "libei"}, {"type", to_string(type)}});
+        }
+    }
+    
+    uint64_t coalesced = queue_stats.coalesced;
+    uint64_t depth = 0;
+    uint64_t eis_clients = 0;
+    uint64_t eis_paused = 0;
+    for (const auto& [handle, session] : sessions) {
+        coalesced += session->eis_motion.coalesced_count();
+        depth += session->outgoing.size();
+        eis_clients += session->eis_client ? 1 : 0;
+        eis_paused += session->eis_paused ? 1 : 0;
+    }
+    metrics.family("hypr_remote_input_events_coalesced_total", "counter", "Motion and scroll events merged into a later one");
+    metrics.sample("hypr_remote_input_events_coalesced_total", coalesced, {{"frontend", "portal"}});
+    if (libei_session) {
+        metrics.sample("hypr_remote_input_events_coalesced_total", libei_session->eis_motion.coalesced_count(), {{"frontend", "libei"}});
+        depth += libei_session->outgoing.size();
+    }
+    metrics.family("hypr_remote_input_events_dropped_total", "counter", "Input events that could not be forwarded");
+    metrics.sample("hypr_remote_input_events_dropped_total", input_stats.dropped, {{"frontend", "portal"}});
+    if (libei_session) {
+        metrics.sample("hypr_remote_input_events_dropped_total", libei_input_stats.dropped + libei_handler->dropped_count(),
+                       {{"frontend", "libei"}});
+    }
+    
+    if (wayland) {
+        metrics.family("hypr_remote_wayland_requests_total", "counter", "Requests sent on the virtual pointers and keyboards");
+        for (size_t i = 0; i < static_cast<size_t>(WaylandRequest::Count); i++) {
+            auto request = static_cast<WaylandRequest>(i);
+            metrics.sample("hypr_remote_wayland_requests_total", wayland->request_count(request),
+                           {{"request", to_string(request)}});
+        }
+        metrics.family("hypr_remote_wayland_flushes_total", "counter", "Flushes of the Wayland connection that went through");
+        metrics.sample("hypr_remote_wayland_flushes_total", wayland->flush_count());
+        metrics.family("hypr_remote_wayland_stalls_total", "counter", "Flushes that found the Wayland socket full (EAGAIN)");
+        metrics.sample("hypr_remote_wayland_stalls_total", wayland->stall_count());
+    }
+    
+    metrics.family("hypr_remote_sessions", "gauge", "RemoteDesktop sessions");
+    metrics.sample("hypr_remote_sessions", sessions.size(), {{"state", "active"}});
+    metrics.sample("hypr_remote_sessions", closed_sessions.size(), {{"state", "closing"}});
+    metrics.family("hypr_remote_eis_clients", "gauge", "EIS clients connected to a session");
+    metrics.sample("hypr_remote_eis_clients", eis_clients);
+    metrics.family("hypr_remote_eis_clients_paused", "gauge", "EIS clients not being read because their queue is full");
+    metrics.sample("hypr_remote_eis_clients_paused", eis_paused);
+    
+    metrics.family("hypr_remote_queue_depth", "gauge", "Entries waiting for a stalled compositor, by session");
+    for (const auto& [handle, session] : sessions) {
+        metrics.sample("hypr_remote_queue_depth", session->outgoing.size(), {{"session", std::to_string(session->id)}});
+    }
+    if (libei_session) {
+        metrics.sample("hypr_remote_queue_depth", libei_session->outgoing.size(), {{"session", "0"}});
+    }
+    metrics.family("hypr_remote_queue_depth_total", "gauge", "Entries waiting for a stalled compositor");
+    metrics.sample("hypr_remote_queue_depth_total", depth);
+    metrics.family("hypr_remote_queue_depth_max", "gauge", "Longest any session's queue has been");
+    metrics.sample("hypr_remote_queue_depth_max", queue_stats.max_depth);
+    metrics.family("hypr_remote_queued_total", "counter", "Entries that had to wait for the compositor");
+    metrics.sample("hypr_remote_queued_total", queue_stats.queued);
+    metrics.family("hypr_remote_queue_overflows_total", "counter", "Entries queued past the queue limit");
+    metrics.sample("hypr_remote_queue_overflows_total", queue_stats.overflowed);
+    metrics.family("hypr_remote_eis_pauses_total", "counter", "Times an EIS client stopped being read");
+    metrics.sample("hypr_remote_eis_pauses_total", queue_stats.paused);
+    metrics.family("hypr_remote_log_records_dropped_total", "counter", "Log records lost because the log buffer was full");
+    metrics.sample("hypr_remote_log_records_dropped_total", Logger::dropped());
+    
+    if (latency) {
+        metrics.family("hypr_remote_latency_seconds", "summary", "Input latency by stage and event kind; no session label for all sessions");
+        for (const auto& s : latency->summarize()) {
+            for (auto [quantile, ns] : {std::pair{"0.5", s.p50_ns}, std::pair{"0.99", s.p99_ns}, std::pair{"1", s.max_ns}}) {
+                metrics.sample("hypr_remote_latency_seconds", ns / 1e9,
+                               {{"session", s.session}, {"stage", to_string(s.stage)},
+                                {"kind", to_string(s.kind)}, {"quantile", quantile}});
+            }
+            metrics.sample("hypr_remote_latency_seconds_sum", s.sum_ns / 1e9,
+                           {{"session", s.session}, {"stage", to_string(s.stage)}, {"kind", to_string(s.kind)}});
+            metrics.sample("hypr_remote_latency_seconds_count", s.count,
+                           {{"session", s.session}, {"stage", to_string(s.stage)}, {"kind", to_string(s.kind)}});
+        }
+    }
+    
+    metrics.family("hypr_remote_thread_cpu_seconds_total", "counter", "CPU time used by each thread of the daemon");
+    for (const auto& thread : read_thread_cpu_times()) {
+        std::string tid = std::to_string(thread.tid);
+        metrics.sample("hypr_remote_thread_cpu_seconds_total", thread.user_seconds,
+                       {{"thread", thread.name}, {"tid", tid}, {"mode", "user"}});
+        metrics.sample("hypr_remote_thread_cpu_seconds_total", thread.system_seconds,
+                       {{"thread", thread.name}, {"tid", tid}, {"mode", "system"}});
+    }
+    
+    if (frame_clock.attached()) {
+        metrics.family("hypr_remote_motion_frames_total", "counter", "Frame clock ticks that sent resampled motion");
+        metrics.sample("hypr_remote_motion_frames_total", frame_clock.tick_count());
+        metrics.family("hypr_remote_motion_frame_period_seconds", "gauge", "Interval motion is resampled to");
+        metrics.sample("hypr_remote_motion_frame_period_seconds", frame_clock.period_ns() / 1e9);
+    }
+    
+    metrics.family("hypr_remote_input_scheduling_info", "gauge", "Scheduling of the input thread");
+    metrics.sample("hypr_remote_input_scheduling_info", 1, {{"scheduling", input_scheduling}});
+    return metrics.text();
+}
+
 void Portal::cleanup() {
-    running = false;
+    if (wayland) {
+        wayland->get_outputs().set_change_listener(nullptr);
+        wayland->get_keymap().set_change_listener(nullptr);
+        wayland->set_writable_listener(nullptr);
+    }
+    
+    // Nothing may stay pressed once we're gone. Closing a session with a
+    // full queue mustn't start reading the EIS clients again.
+    eis_reading_paused = false;
+    while (!sessions.empty()) {
+        close_session(sessions.begin()->first);
+    }
+    closed_sessions.clear();
+    if (libei_session) {
+        release_input(*libei_session);
+        libei_handler->set_input_sink(nullptr);
+        libei_session.reset();
+    }
+    
+    eis_pending_sessions.clear();
+    if (eis_context) {
+        if (event_loop) {
+            event_loop->remove_fd(eis_get_fd(eis_context));
+        }
+        eis_unref(eis_context);
+        eis_context = nullptr;
+    }
+    
+    frame_clock.cleanup();
+    if (event_loop) {
+        if (connection) {
+            auto poll_data = connection->getEventLoopPollData();
+            event_loop->remove_fd(poll_data.fd);
+            event_loop->remove_fd(poll_data.eventFd);
+        }
+        event_loop = nullptr;
+    }
+    
+    keysym_index.clear();
     
     if (object) {
         object.reset();
@@ -274,248 +532,368 @@ void Portal::cleanup() {
     }
 }
 
-void Portal::run() {
-    if (!connection) return;
+bool Portal::attach(EventLoop& loop) {
+    if (!connection) return false;
+    
+    event_loop = &loop;
+    
+    // sd-bus tells us which fd, events and timeout it needs; its internal
+    // eventfd is signalled when messages are queued from elsewhere
+    auto poll_data = connection->getEventLoopPollData();
+    if (!loop.add_fd(poll_data.fd, poll_data.events, [this](uint32_t) { process_dbus(); })) {
+        return false;
+    }
+    if (poll_data.eventFd >= 0) {
+        int event_fd = poll_data.eventFd;
+        if (!loop.add_fd(event_fd, EPOLLIN, [this, event_fd](uint32_t) {
+                uint64_t value;
+                ssize_t rc = read(event_fd, &value, sizeof(value));
+                (void)rc;
+                process_dbus();
+            })) {
+            return false;
+        }
+    }
+    loop.add_prepare_hook([this]() { return prepare_dbus(); });
     
-    running = true;
+    if (!loop.add_fd(eis_get_fd(eis_context), EPOLLIN, [this](uint32_t) { dispatch_eis(); })) {
+        return false;
+    }
     
-    std::cout << "🔄 Starting proper sdbus D-Bus event loop..." << std::endl;
-    std::cout << "📡 Portal ready to receive D-Bus calls!" << std::endl;
+    if (resample_motion) {
+        if (!frame_clock.attach(loop, [this]() { send_deferred_motion(); })) {
+            return false;
+        }
+        LOG_INFO("🖱️ Motion resampled to the output refresh rate");
+    }
+    
+    // Sessions closed during the last round of dispatching are destroyed here,
+    // outside of any of their own callbacks. Ones whose releases still wait
+    // for a stalled compositor stay until drain_outgoing() has sent them.
+    loop.add_prepare_hook([this]() {
+        size_t before = closed_sessions.size();
+        std::erase_if(closed_sessions, [](const auto& session) { return session->outgoing.empty(); });
+        if (closed_sessions.size() != before) {
+            // Send the destroy requests of their virtual devices
+            if (wayland) {
+                wayland->flush();
+            }
+        }
+        return -1;
+    });
     
+    LOG_INFO("📡 Portal ready to receive D-Bus calls!");
+    return true;
+}
+
+void Portal::process_dbus() {
     try {
-        // Use the official sdbus event loop 
-        // This will block and properly handle all incoming D-Bus method calls
-        connection->enterEventLoop();
+        while (connection->processPendingEvent()) {
+        }
     } catch (const sdbus::Error& e) {
-        std::cerr << "D-Bus error in portal loop: " << e.what() << std::endl;
+        LOG_ERROR("D-Bus error in portal loop: " << e.what());
     }
-    
-    std::cout << "🛑 D-Bus event loop stopped" << std::endl;
 }
 
-void Portal::stop() {
-    running = false;
-    // Exit the sdbus event loop cleanly
-    if (connection) {
-        connection->leaveEventLoop();
+int Portal::prepare_dbus() {
+    if (!connection) return -1;
+    
+    auto poll_data = connection->getEventLoopPollData();
+    if (poll_data.getPollTimeout() == 0) {
+        // A D-Bus timer already expired (e.g. a method call timeout)
+        process_dbus();
+        poll_data = connection->getEventLoopPollData();
     }
+    
+    // sd-bus may want POLLOUT while it has unsent messages; poll and epoll
+    // share the same bit values for IN/OUT/PRI
+    event_loop->modify_fd(poll_data.fd, static_cast<uint32_t>(poll_data.events));
+    return poll_data.getPollTimeout();
 }
 
 sdbus::UnixFd Portal::ConnectToEIS(sdbus::ObjectPath session_handle, std::string app_id, std::map<std::string, sdbus::Variant> options) {
-    if (verbose) {
-        std::cout << "📋 ConnectToEIS implementation started" << std::endl;
-        std::cout << "  Session: " << session_handle << std::endl;
-        std::cout << "  App: " << app_id << std::endl;
-        for (const auto& [key, val] : options) {
-            std::cout << "  Option: " << key << std::endl;
-        }
+    LOG_DEBUG("📋 ConnectToEIS implementation started");
+    LOG_DEBUG("  Session: " << session_handle);
+    LOG_DEBUG("  App: " << app_id);
+    for (const auto& [key, val] : options) {
+        LOG_DEBUG("  Option: " << key);
     }
+
     
-    if (!libei_handler || !libei_handler->keyboard || !libei_handler->pointer) {
-        std::cerr << "Virtual devices not available" << std::endl;
+    // The session's own devices are created here, before the client starts sending
+    Session& session = session_for(session_handle, app_id);
+    if (!session.keyboard() || !session.pointer()) {
+        LOG_ERROR("Virtual devices not available");
         throw sdbus::Error(sdbus::Error::Name{"org.freedesktop.portal.Error.Failed"}, "Virtual devices not available");
     }
     
-    // Create a socket pair - one end for deskflow, one end for our EIS server
-    int socket_pair[2];
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socket_pair) == -1) {
-        std::cerr << "Error creating socket pair: " << strerror(errno) << std::endl;
-        throw sdbus::Error(sdbus::Error::Name{"org.freedesktop.portal.Error.Failed"}, "Failed to create socket pair");
+    if (!eis_context) {
+        LOG_ERROR("EIS server context not available");
+        throw sdbus::Error(sdbus::Error::Name{"org.freedesktop.portal.Error.Failed"}, "EIS server not available");
+    }
+    
+    // Let the shared EIS context create the socket pair and adopt the server end;
+    // the returned fd is the client end that goes to deskflow
+    int client_fd = eis_backend_fd_add_client(eis_context);
+    if (client_fd < 0) {
+        LOG_ERROR("Error adding EIS client: " << strerror(-client_fd));
+        throw sdbus::Error(sdbus::Error::Name{"org.freedesktop.portal.Error.Failed"}, "Failed to add EIS client");
     }
+    // libeis only reports the client once its handshake is done
+    eis_pending_sessions.push_back(session.handle);
+    
+    LOG_INFO("✅ ConnectToEIS completed - client fd " << client_fd << " sent to deskflow");
     
-    int client_fd = socket_pair[0];  // This goes to deskflow
-    int server_fd = socket_pair[1];  // This stays with us for EIS server
+    // Hand ownership of the client end to the reply so we don't keep a copy open
+    return sdbus::UnixFd{client_fd, sdbus::adopt_fd};
+}
+
+bool Portal::setup_keymap() {
+    // The keymap is compiled once per layout by SharedKeymap;
+    // NotifyKeyboardKeysym only does index lookups
+    if (!wayland || !wayland->get_keymap().keymap()) {
+        LOG_ERROR("No XKB keymap available");
+        return false;
+    }
     
-    std::cout << "✅ Created socket pair - client_fd: " << client_fd << ", server_fd: " << server_fd << std::endl;
+    keysym_index.rebuild(wayland->get_keymap().keymap());
+    LOG_INFO("🗝️ Keysym index built with " << keysym_index.size() << " entries");
+    return true;
+}
+
+void Portal::update_keymap() {
+    setup_keymap();
     
-    // Start a thread to run a proper EIS server
-    std::thread([this, server_fd]() {
-        std::cout << "📡 Starting proper EIS server thread..." << std::endl;
+    // EIS keymaps are fixed once a device is added, so the keyboard is replaced
+    for (auto& [handle, session] : sessions) {
+        if (!session->eis_keyboard) continue;
         
-        // Create EIS server context (similar to hyprland-eis)
-        struct eis* eis_context = eis_new(nullptr);
-        if (!eis_context) {
-            std::cerr << "Failed to create EIS server context" << std::endl;
-            close(server_fd);
-            return;
+        eis_device_remove(session->eis_keyboard);
+        eis_device_unref(session->eis_keyboard);
+        session->eis_keyboard = nullptr;
+        add_eis_keyboard(*session);
+        LOG_INFO("🗝️ EIS: Updated keyboard layout for session " << handle);
+    }
+}
+
+Session& Portal::session_for(const std::string& handle, const std::string& app_id) {
+    auto it = sessions.find(handle);
+    if (it != sessions.end()) {
+        if (it->second->app_id.empty()) {
+            it->second->app_id = app_id;
         }
+        return *it->second;
+    }
+    
+    // Callers that skip CreateSession (e.g. ConnectToEIS straight away) still
+    // get a session of their own
+    auto session = std::make_unique<Session>(handle, app_id, wayland);
+    session->id = ++last_session_id;
+    if (latency) {
+        session->latency = latency->session(handle);
+    }
+    
+    try {
+        session->object = sdbus::createObject(*connection, sdbus::ObjectPath{handle});
         
-        // Set up logging (optional, for debugging)
-        // eis_log_set_priority(eis_context, EIS_LOG_PRIORITY_DEBUG);
-        
-        std::cout << "✅ EIS server context created" << std::endl;
-        
-        // Create a temporary socket and immediately connect our FD to it
-        // This is a workaround since libeis may not support direct FD setup
+        auto close = sdbus::registerMethod("Close");
+        close.inputSignature = "";
+        close.outputSignature = "";
+        close.implementedAs([this, handle]() {
+            LOG_INFO("🚪 Session closed by client: " << handle);
+            close_session(handle);
+        });
         
-        // Alternative approach: Create a proper EIS server socket and handle the connection
-        char socket_path[256];
-        snprintf(socket_path, sizeof(socket_path), "/tmp/hypr-portal-eis-%d", getpid());
+        auto closed = sdbus::registerSignal("Closed");
         
-        // Setup EIS backend with temporary socket
-        int rc = eis_setup_backend_socket(eis_context, socket_path);
-        if (rc != 0) {
-            std::cerr << "Failed to setup EIS backend socket: " << strerror(errno) << std::endl;
-            eis_unref(eis_context);
-            close(server_fd);
-            return;
-        }
-        
-        std::cout << "✅ EIS backend socket created at: " << socket_path << std::endl;
+        auto versionProp = sdbus::registerProperty("version");
+        versionProp.withGetter([](){ return static_cast<uint32_t>(1); });
         
-        // Now we need to bridge between our socket_pair and the EIS socket
-        // Start a bridge thread to forward data between them
-        std::thread bridge_thread([server_fd, socket_path]() {
-            std::cout << "🌉 Starting socket bridge..." << std::endl;
-            
-            // Connect to the EIS socket
-            int eis_sock = socket(AF_UNIX, SOCK_STREAM, 0);
-            if (eis_sock == -1) {
-                std::cerr << "Failed to create bridge socket" << std::endl;
-                return;
-            }
-            
-            struct sockaddr_un addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sun_family = AF_UNIX;
-            strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
-            
-            // Wait a bit for the EIS server to start
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            
-            if (connect(eis_sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-                std::cerr << "Failed to connect to EIS socket: " << strerror(errno) << std::endl;
-                close(eis_sock);
-                return;
-            }
-            
-            std::cout << "✅ Bridge connected to EIS socket" << std::endl;
-            
-            // Bridge data bidirectionally between server_fd and eis_sock
-            fd_set read_fds;
-            char buffer[4096];
-            
-            // Make sockets non-blocking for better performance
-            int flags = fcntl(server_fd, F_GETFL, 0);
-            fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
-            flags = fcntl(eis_sock, F_GETFL, 0);
-            fcntl(eis_sock, F_SETFL, flags | O_NONBLOCK);
-            
-            while (true) {
-                FD_ZERO(&read_fds);
-                FD_SET(server_fd, &read_fds);
-                FD_SET(eis_sock, &read_fds);
-                
-                int max_fd = std::max(server_fd, eis_sock);
-                struct timeval timeout = {0, 100000}; // 100ms timeout for better responsiveness
-                
-                int activity = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
-                
-                if (activity < 0) {
-                    std::cerr << "Bridge select error: " << strerror(errno) << std::endl;
-                    break;
-                }
-                
-                if (activity == 0) continue; // timeout
-                
-                // Forward data from deskflow (server_fd) to EIS server (eis_sock)
-                if (FD_ISSET(server_fd, &read_fds)) {
-                    ssize_t bytes = read(server_fd, buffer, sizeof(buffer));
-                    if (bytes <= 0) {
-                        if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                            std::cout << "Deskflow disconnected from bridge" << std::endl;
-                            break;
-                        }
-                    } else {
-                        if (write(eis_sock, buffer, bytes) != bytes) {
-                            std::cerr << "Failed to forward data to EIS server" << std::endl;
-                            break;
-                        }
-                        //std::cout << "🔄 Forwarded " << bytes << " bytes from deskflow to EIS" << std::endl;
-                    }
-                }
-                
-                // Forward data from EIS server (eis_sock) to deskflow (server_fd)
-                if (FD_ISSET(eis_sock, &read_fds)) {
-                    ssize_t bytes = read(eis_sock, buffer, sizeof(buffer));
-                    if (bytes <= 0) {
-                        if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                            std::cout << "EIS server disconnected from bridge" << std::endl;
-                            break;
-                        }
-                    } else {
-                        if (write(server_fd, buffer, bytes) != bytes) {
-                            std::cerr << "Failed to forward data to deskflow" << std::endl;
-                            break;
-                        }
-                        //std::cout << "🔄 Forwarded " << bytes << " bytes from EIS to deskflow" << std::endl;
-                    }
-                }
-            }
-            
-            std::cout << "🌉 Socket bridge stopped" << std::endl;
-            close(eis_sock);
-        });
-        bridge_thread.detach();
-        
-        // Run the EIS server event loop (adapted from hyprland-eis)
-        std::cout << "🚀 Starting EIS server event loop..." << std::endl;
-        
-        bool stop = false;
-        struct pollfd fds = {
-            .fd = eis_get_fd(eis_context),
-            .events = POLLIN,
-            .revents = 0,
-        };
-        
-        while (!stop) {
-            int nevents = poll(&fds, 1, 100); // Reduced timeout to 100ms for better responsiveness
-            if (nevents == -1) {
-                std::cerr << "EIS poll error: " << strerror(errno) << std::endl;
-                break;
-            }
-            
-            if (nevents == 0) continue; // timeout
-            
-            // Process all pending EIS events in one go - this is crucial for scroll
-            eis_dispatch(eis_context);
-            
-            // Handle ALL events in the queue immediately
-            struct eis_event* event;
-            int event_count = 0;
-            while ((event = eis_get_event(eis_context)) != nullptr) {
-                event_count++;
-                //std::cout << "🎯 EIS: Processing event " << event_count << " type=" << eis_event_get_type(event) << std::endl;
-                
-                // Handle EIS events and forward to virtual devices
-                handle_eis_event(event);
-                eis_event_unref(event);
+        session->object->addVTable(
+            sdbus::InterfaceName{SESSION_INTERFACE},
+            std::move(close),
+            std::move(closed),
+            std::move(versionProp)
+        );
+    } catch (const sdbus::Error& e) {
+        // Input still works without it; the session just can't be closed over D-Bus
+        LOG_WARN("Failed to export session object " << handle << ": " << e.what());
+        session->object.reset();
+    }
+    
+    if (capture) {
+        capture->record(CaptureSource::Session, CaptureType::SessionCreated, session->id);
+    }
+    LOG_INFO("🆕 Session created: " << handle << " (" << sessions.size() + 1 << " active)");
+    Session& result = *session;
+    sessions.emplace(handle, std::move(session));
+    return result;
+}
+
+void Portal::close_session(const std::string& handle) {
+    auto it = sessions.find(handle);
+    if (it == sessions.end()) return;
+    
+    Session& session = *it->second;
+    release_input(session);
+    // Its histograms would otherwise outlive it, one set per session ever opened
+    if (latency) {
+        latency->remove_session(session.handle);
+        session.latency = nullptr;
+    }
+    if (capture) {
+        capture->record(CaptureSource::Session, CaptureType::SessionClosed, session.id);
+    }
+    
+    session.disconnect_eis();
+    bool paused = session.eis_paused;
+    session.state = Session::State::Closed;
+    queue_stats.coalesced += session.eis_motion.coalesced_count();
+    
+    // The D-Bus object may be in the middle of handling Close; destroy it later
+    closed_sessions.push_back(std::move(it->second));
+    sessions.erase(it);
+    LOG_INFO("🚪 Session released: " << handle << " (" << sessions.size() << " active)");
+    // Its full queue no longer holds up the other sessions' clients
+    if (paused) {
+        resume_input(*closed_sessions.back());
+    }
+}
+
+void Portal::release_input(Session& session) {
+    // Don't lose what the client already sent
+    commit_eis_frame(session);
+    
+    uint32_t time = wayland_time(receive_time_ns());
+    bool sent = false;
+    
+    // Only sessions that pressed something have the device to release it on
+    if (!session.pressed_buttons.empty()) {
+        if (session.pointer()) {
+            for (uint32_t button : session.pressed_buttons) {
+                emit_button(session, time, button, 0);
             }
-            
-            if (event_count > 0) {
-                std::cout << "📊 EIS: Processed " << event_count << " events in this cycle" << std::endl;
+            sent = true;
+        }
+    }
+    session.pressed_buttons.clear();
+    
+    bool modifiers_held = session.modifier_state_depressed || session.modifier_state_latched;
+    if (!session.pressed_keys.empty() || modifiers_held) {
+        bool keyboard = session.keyboard() != nullptr;
+        if (keyboard) {
+            for (uint32_t key : session.pressed_keys) {
+                emit_key(session, time, key, 0);
             }
+            sent = true;
         }
-        
-        std::cout << "📡 EIS server thread stopped" << std::endl;
-        unlink(socket_path); // Clean up socket file
+        session.pressed_keys.clear();
+        if (session.release_modifiers() && keyboard) {
+            emit_modifier_state(session);
+        }
+    }
+    
+    if (sent) {
+        LOG_DEBUG("Released input held by session " << session.handle);
+        commit_eis_frame(session);
+    }
+}
+
+bool Portal::setup_eis() {
+    // One long-lived EIS server context serves every ConnectToEIS client
+    eis_context = eis_new(nullptr);
+    if (!eis_context) {
+        LOG_ERROR("Failed to create EIS server context");
+        return false;
+    }
+    
+    int rc = eis_setup_backend_fd(eis_context);
+    if (rc != 0) {
+        LOG_ERROR("Failed to setup EIS fd backend: " << strerror(-rc));
         eis_unref(eis_context);
-        close(server_fd);
-    }).detach();
+        eis_context = nullptr;
+        return false;
+    }
     
-    std::cout << "✅ ConnectToEIS completed - socket fd sent to deskflow" << std::endl;
-    std::cout << "🎯 Deskflow can now send EIS events through fd " << client_fd << std::endl;
-    std::cout << "📡 Proper EIS server thread is running with socket bridge" << std::endl;
+    LOG_INFO("✅ EIS server context created");
+    return true;
+}
+
+void Portal::dispatch_eis() {
+    begin_dispatch();
+    // Process all pending EIS events in one go - this is crucial for scroll
+    eis_dispatch(eis_context);
     
-    // Return the client file descriptor to deskflow
-    return sdbus::UnixFd{client_fd};
+    // Sessions that got input, so each one's frame is committed once at the end
+    std::vector<Session*> dispatched;
+    struct eis_event* event;
+    int event_count = 0;
+    while ((event = eis_peek_event(eis_context)) != nullptr) {
+        Session* session = eis_session(event);
+        eis_event_unref(event);
+        // A stalled compositor and a full queue: leave the rest with libeis
+        // and stop reading, so the clients feel the backpressure instead
+        if (session && session->outgoing.size() >= max_queued) {
+            pause_input(*session);
+            break;
+        }
+        
+        event = eis_get_event(eis_context);
+        event_count++;
+        if (eis_event_get_type(event) == EIS_EVENT_CLIENT_CONNECT) {
+            session = claim_eis_client(eis_event_get_client(event));
+        }
+        if (session) {
+            handle_eis_event(*session, event);
+            if (std::find(dispatched.begin(), dispatched.end(), session) == dispatched.end()) {
+                dispatched.push_back(session);
+            }
+        }
+        eis_event_unref(event);
+    }
+    
+    // Clients are expected to end every batch with a frame; don't hold
+    // anything back if one didn't
+    for (Session* session : dispatched) {
+        commit_eis_frame(*session);
+    }
+    
+    if (event_count > 0) {
+        LOG_TRACE("📊 EIS: Processed " << event_count << " events in this cycle");
+    }
 }
 
-void Portal::handle_eis_event(struct eis_event* event) {
+Session* Portal::eis_session(struct eis_event* event) const {
+    struct eis_client* client = eis_event_get_client(event);
+    return client ? static_cast<Session*>(eis_client_get_user_data(client)) : nullptr;
+}
+
+Session* Portal::claim_eis_client(struct eis_client* client) {
+    // Sessions closed before their client got this far are skipped
+    while (!eis_pending_sessions.empty()) {
+        auto it = sessions.find(eis_pending_sessions.front());
+        eis_pending_sessions.pop_front();
+        if (it != sessions.end()) {
+            return it->second.get();
+        }
+    }
+    LOG_WARN("🔌 EIS: Rejecting client " << eis_client_get_name(client) << ", its session is gone");
+    eis_client_disconnect(client);
+    return nullptr;
+}
+
+void Portal::handle_eis_event(Session& session, struct eis_event* event) {
     enum eis_event_type type = eis_event_get_type(event);
+    if (capture) {
+        capture_eis_event(session, event);
+    }
+    if (is_input_event(type)) {
+        // Events of one frame share the time the client stamped it with
+        session.event_time = wayland_time(session.client_clock.map(eis_event_get_time(event), receive_time_ns()));
+    }
     
-    // Log events based on verbose mode
-    if (verbose) {
+    // Per-event names are only worth building when tracing
+    if (Logger::enabled(LogLevel::Trace)) {
         const char* event_name = "UNKNOWN";
         switch (type) {
             case EIS_EVENT_CLIENT_CONNECT: event_name = "CLIENT_CONNECT"; break;
@@ -528,20 +906,29 @@ void Portal::handle_eis_event(struct eis_event* event) {
             case EIS_EVENT_BUTTON_BUTTON: event_name = "BUTTON_BUTTON"; break;
             case EIS_EVENT_SCROLL_DELTA: event_name = "SCROLL_DELTA"; break;
             case EIS_EVENT_SCROLL_DISCRETE: event_name = "SCROLL_DISCRETE"; break;
+            case EIS_EVENT_SCROLL_STOP: event_name = "SCROLL_STOP"; break;
+            case EIS_EVENT_SCROLL_CANCEL: event_name = "SCROLL_CANCEL"; break;
             case EIS_EVENT_KEYBOARD_KEY: event_name = "KEYBOARD_KEY"; break;
             case EIS_EVENT_FRAME: event_name = "FRAME"; break;
             default: event_name = "UNKNOWN"; break;
         }
-        std::cout << "🔥 EIS EVENT: " << event_name << " (type=" << type << ")" << std::endl;
+        LOG_TRACE("🔥 EIS EVENT: " << event_name << " (type=" << type << ")");
     }
     
     switch (type) {
         case EIS_EVENT_CLIENT_CONNECT: {
             struct eis_client* client = eis_event_get_client(event);
-            std::cout << "🔌 EIS: Client connected: " << eis_client_get_name(client) << std::endl;
+            LOG_INFO("🔌 EIS: Client connected: " << eis_client_get_name(client));
             
             // Accept the client connection
             eis_client_connect(client);
+            if (session.eis_client) {
+                // A second ConnectToEIS replaces the session's earlier client
+                eis_client_set_user_data(session.eis_client, nullptr);
+                eis_client_unref(session.eis_client);
+            }
+            session.eis_client = eis_client_ref(client);
+            eis_client_set_user_data(client, &session);
             
             // Add a seat for this client (required for devices)
             struct eis_seat* seat = eis_client_new_seat(client, "hyprland-portal-seat");
@@ -552,98 +939,57 @@ void Portal::handle_eis_event(struct eis_event* event) {
             eis_seat_configure_capability(seat, EIS_DEVICE_CAP_SCROLL);
             eis_seat_add(seat);
             
-            std::cout << "💺 EIS: Seat added for client with capabilities" << std::endl;
+            LOG_INFO("💺 EIS: Seat added for client with capabilities");
             break;
         }
         
-        case EIS_EVENT_CLIENT_DISCONNECT:
-            std::cout << "🔌 EIS: Client disconnected" << std::endl;
+        case EIS_EVENT_CLIENT_DISCONNECT: {
+            LOG_INFO("🔌 EIS: Client disconnected");
+            // The session outlives its EIS client, but nothing it held may stay pressed
+            release_input(session);
+            struct eis_client* client = eis_event_get_client(event);
+            if (client == session.eis_client) {
+                session.drop_eis_devices();
+                eis_client_set_user_data(session.eis_client, nullptr);
+                eis_client_unref(session.eis_client);
+                session.eis_client = nullptr;
+            }
             break;
+        }
             
         case EIS_EVENT_SEAT_BIND: {
             struct eis_seat* seat = eis_event_get_seat(event);
-            std::cout << "💺 EIS: Seat bound by client" << std::endl;
-            
-            // Add pointer device
-            struct eis_device* pointer = eis_seat_new_device(seat);
-            eis_device_configure_name(pointer, "Hyprland Portal Pointer");
-            eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER);
-            eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER_ABSOLUTE);
-            eis_device_configure_capability(pointer, EIS_DEVICE_CAP_BUTTON);
-            eis_device_configure_capability(pointer, EIS_DEVICE_CAP_SCROLL);
-            
-            // Set pointer region (screen size)
-            struct eis_region* region = eis_device_new_region(pointer);
-            eis_region_set_size(region, 1920, 1080); // TODO: Get actual screen size
-            eis_region_add(region);
-            
-            eis_device_add(pointer);
-            eis_device_resume(pointer);
+            LOG_INFO("💺 EIS: Seat bound by client");
             
-            // Add keyboard device with proper keymap setup
-            struct eis_device* keyboard = eis_seat_new_device(seat);
-            eis_device_configure_name(keyboard, "Hyprland Portal Keyboard");
-            eis_device_configure_capability(keyboard, EIS_DEVICE_CAP_KEYBOARD);
+            session.drop_eis_devices();
+            session.eis_seat = eis_seat_ref(seat);
+            add_eis_pointer(session);
             
-            // Set up a basic keymap for proper modifier key handling
-            // This is crucial for key combinations like Meta+Enter to work
-            const char* keymap_str = 
-                "xkb_keymap {\n"
-                "xkb_keycodes  { include \"evdev+aliases(qwerty)\" };\n"
-                "xkb_types     { include \"complete\" };\n"
-                "xkb_compat    { include \"complete\" };\n"
-                "xkb_symbols   { include \"pc+us+inet(evdev)\" };\n"
-                "xkb_geometry  { include \"pc(pc105)\" };\n"
-                "};\n";
-                
-            // Create a memory file for the keymap
-            size_t keymap_size = strlen(keymap_str);
-            int memfd = memfd_create("keymap", MFD_CLOEXEC);
-            if (memfd >= 0) {
-                if (write(memfd, keymap_str, keymap_size) == (ssize_t)keymap_size) {
-                    struct eis_keymap* keymap = eis_device_new_keymap(keyboard, 
-                        EIS_KEYMAP_TYPE_XKB, memfd, keymap_size);
-                    if (keymap) {
-                        eis_keymap_add(keymap);
-                        std::cout << "🗝️ EIS: Keymap configured for proper modifier handling" << std::endl;
-                    }
-                }
-                close(memfd);
-            }
-            
-            eis_device_add(keyboard);
-            eis_device_resume(keyboard);
+            add_eis_keyboard(session);
             
-            std::cout << "🖱️ EIS: Pointer and keyboard devices added with enhanced features" << std::endl;
+            LOG_INFO("🖱️ EIS: Pointer and keyboard devices added with enhanced features");
             break;
         }
         
         case EIS_EVENT_DEVICE_START_EMULATING: {
             struct eis_device* device = eis_event_get_device(event);
-            std::cout << "🎮 EIS: Device started emulating: " << eis_device_get_name(device) << std::endl;
+            LOG_INFO("🎮 EIS: Device started emulating: " << eis_device_get_name(device));
             break;
         }
         
         case EIS_EVENT_DEVICE_STOP_EMULATING: {
             struct eis_device* device = eis_event_get_device(event);
-            std::cout << "🎮 EIS: Device stopped emulating: " << eis_device_get_name(device) << std::endl;
+            LOG_INFO("🎮 EIS: Device stopped emulating: " << eis_device_get_name(device));
             break;
         }
         
         case EIS_EVENT_POINTER_MOTION: {
-            double dx = eis_event_pointer_get_dx(event);
-            double dy = eis_event_pointer_get_dy(event);
+            InputEvent input = make_input_event(InputEventType::Motion, session.id, session.event_time);
+            input.d[0] = eis_event_pointer_get_dx(event);
+            input.d[1] = eis_event_pointer_get_dy(event);
             
-            std::cout << "🖱️ EIS: Pointer motion dx=" << dx << " dy=" << dy << std::endl;
-            
-            // Forward to virtual pointer
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_motion(time, dx, dy);
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Motion forwarded to virtual pointer" << std::endl;
-            }
+            LOG_TRACE("🖱️ EIS: Pointer motion dx=" << input.d[0] << " dy=" << input.d[1]);
+            submit_input(session, input);
             break;
         }
         
@@ -651,235 +997,814 @@ void Portal::handle_eis_event(struct eis_event* event) {
             double x = eis_event_pointer_get_absolute_x(event);
             double y = eis_event_pointer_get_absolute_y(event);
             
-            std::cout << "🖱️ EIS: Pointer absolute motion x=" << x << " y=" << y << std::endl;
+            LOG_TRACE("🖱️ EIS: Pointer absolute motion x=" << x << " y=" << y);
             
-            // Forward to virtual pointer  
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_motion_absolute(time, 
-                    static_cast<uint32_t>(x), static_cast<uint32_t>(y), 1920, 1080);
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Absolute motion forwarded to virtual pointer" << std::endl;
+            // Regions are laid out from the top-left corner of the monitor
+            // layout; map into it at sub-pixel precision
+            InputEvent input = make_input_event(InputEventType::MotionAbsolute, session.id, session.event_time);
+            if (!wayland || !wayland->get_outputs().to_absolute(x, y, input.u[0], input.u[1], input.u[2], input.u[3])) {
+                LOG_WARN("❌ Cannot forward absolute motion - no output geometry known");
+                input_stats.dropped++;
+                break;
             }
+            submit_input(session, input);
             break;
         }
         
         case EIS_EVENT_BUTTON_BUTTON: {
-            uint32_t button = eis_event_button_get_button(event);
-            bool is_press = eis_event_button_get_is_press(event);
-            
-            std::cout << "🖱️ EIS: Button " << (is_press ? "press" : "release") << " button=" << button << std::endl;
+            InputEvent input = make_input_event(InputEventType::Button, session.id, session.event_time);
+            input.u[0] = eis_event_button_get_button(event);
+            input.u[1] = eis_event_button_get_is_press(event) ? 1 : 0;
             
-            // Forward to virtual pointer
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_button(time, button, is_press ? 1 : 0);
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Button event forwarded to virtual pointer" << std::endl;
-            }
+            LOG_TRACE("🖱️ EIS: Button " << (input.u[1] ? "press" : "release") << " button=" << input.u[0]);
+            submit_input(session, input);
             break;
         }
         
         case EIS_EVENT_SCROLL_DELTA: {
-            double dx = eis_event_scroll_get_dx(event);
-            double dy = eis_event_scroll_get_dy(event);
-            
-            std::cout << "🖱️ EIS: Scroll delta dx=" << dx << " dy=" << dy << std::endl;
+            InputEvent input = make_input_event(InputEventType::ScrollDelta, session.id, session.event_time);
+            input.d[0] = eis_event_scroll_get_dx(event);
+            input.d[1] = eis_event_scroll_get_dy(event);
             
-            // Debug: Check if we have the required components
-            std::cout << "🔍 DEBUG: libei_handler=" << (libei_handler ? "YES" : "NO") 
-                      << ", pointer=" << (libei_handler && libei_handler->pointer ? "YES" : "NO") << std::endl;
-            
-            // Forward to virtual pointer with proper Wayland scroll protocol
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                
-                std::cout << "🎯 Sending scroll events with time=" << time << std::endl;
-                
-                // Set axis source - wheel is the most common source for EIS scroll events
-                libei_handler->pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
-                    
-                // Scale the scroll values appropriately for Wayland
-                double scale_factor = 15.0; // Good default for smooth scrolling
-                
-                if (dx != 0.0) {
-                    std::cout << "🔄 Sending horizontal scroll: " << (dx * scale_factor) << std::endl;
-                    libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, dx * scale_factor, dy);
-                    // Send axis stop to complete the scroll event
-                    libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL);
-                }
-                if (dy != 0.0) {
-                    std::cout << "🔄 Sending vertical scroll: " << (dy * scale_factor) << std::endl;
-                    libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL, dx * scale_factor, dy);
-                    // Send axis stop to complete the scroll event  
-                    libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_VERTICAL_SCROLL);
-                }
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Scroll delta forwarded with proper axis protocol" << std::endl;
-            } else {
-                std::cout << "❌ Cannot forward scroll - missing virtual pointer!" << std::endl;
-            }
+            LOG_TRACE("🖱️ EIS: Scroll delta dx=" << input.d[0] << " dy=" << input.d[1]);
+            submit_input(session, input);
             break;
         }
         
         case EIS_EVENT_SCROLL_DISCRETE: {
-            int32_t dx = eis_event_scroll_get_discrete_dx(event);
-            int32_t dy = eis_event_scroll_get_discrete_dy(event);
-            
-            if (dx == 0 && dy == 0) {
-                break;
-                // Assume this is a vertical scroll event and give it a default value
-                //dy = -1; // Negative = scroll up (standard)
-                //std::cout << "🔄 Discrete values are 0, assuming vertical scroll step: dy=" << dy << std::endl;
-            }
-
-            std::cout << "🖱️ EIS: Scroll discrete dx=" << dx << " dy=" << dy << std::endl;
+            InputEvent input = make_input_event(InputEventType::ScrollDiscrete, session.id, session.event_time);
+            input.i[0] = eis_event_scroll_get_discrete_dx(event);
+            input.i[1] = eis_event_scroll_get_discrete_dy(event);
             
-            // If discrete values are 0, assume vertical scroll with 1 step (common case)
-                        
-            // Forward discrete scroll if we have actual values (now that we fixed 0,0 case)
-            if (libei_handler && libei_handler->pointer && (dx != 0 || dy != 0)) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                    
-                // Set axis source for discrete scroll (wheel clicks)
-                libei_handler->pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
-                
-                // Use standard scroll value per click - simple and effective
-                double scroll_value = 15.0;
-                int axis = dx == 0 ? WL_POINTER_AXIS_VERTICAL_SCROLL : WL_POINTER_AXIS_HORIZONTAL_SCROLL;
-                libei_handler->pointer->send_axis_discrete(time, dx, dy);
-                // libei_handler->pointer->send_axis_stop(time, axis);
+            LOG_TRACE("🖱️ EIS: Scroll discrete dx=" << input.i[0] << " dy=" << input.i[1]);
+            submit_input(session, input);
+            break;
+        }
+        
+        case EIS_EVENT_SCROLL_STOP:
+        case EIS_EVENT_SCROLL_CANCEL: {
+            // Wayland has no cancel; either way the sequence ends here
+            InputEvent input = make_input_event(InputEventType::ScrollStop, session.id, session.event_time);
+            input.u[0] = eis_event_scroll_get_stop_x(event);
+            input.u[1] = eis_event_scroll_get_stop_y(event);
             
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Scroll discrete forwarded (steps=" << dx << "," << dy << ")" << std::endl;
-            } else {
-                std::cout << "❌ No scroll to forward (dx=" << dx << " dy=" << dy << ") or no pointer available" << std::endl;
-            }
+            LOG_TRACE("🖱️ EIS: Scroll " << (type == EIS_EVENT_SCROLL_STOP ? "stop" : "cancel")
+                      << " x=" << input.u[0] << " y=" << input.u[1]);
+            submit_input(session, input);
             break;
         }
         
         case EIS_EVENT_KEYBOARD_KEY: {
-            uint32_t keycode = eis_event_keyboard_get_key(event);
-            bool is_press = eis_event_keyboard_get_key_is_press(event);
-            
-            std::cout << "⌨️ EIS: Keyboard " << (is_press ? "press" : "release") << " keycode=" << keycode << std::endl;
+            InputEvent input = make_input_event(InputEventType::Key, session.id, session.event_time);
+            input.u[0] = eis_event_keyboard_get_key(event);
+            input.u[1] = eis_event_keyboard_get_key_is_press(event) ? 1 : 0;
             
-            // Debug: Check if we have the required components
-            std::cout << "🔍 DEBUG: libei_handler=" << (libei_handler ? "YES" : "NO") 
-                      << ", keyboard=" << (libei_handler && libei_handler->keyboard ? "YES" : "NO") << std::endl;
-            
-            // Forward to virtual keyboard with immediate modifier updates
-            if (libei_handler && libei_handler->keyboard) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                    
-                std::cout << "🎯 Processing key event with time=" << time << std::endl;
-                
-                // Update modifier state BEFORE sending the key event (using raw keycode)
-                update_modifier_state(keycode, is_press);
-                
-                std::cout << "🔧 Current modifier state: depressed=" << modifier_state_depressed 
-                         << ", latched=" << modifier_state_latched << ", locked=" << modifier_state_locked << std::endl;
-                
-                // Send modifier state first - this is crucial for key combinations like Meta+Enter
-                libei_handler->keyboard->send_modifiers(modifier_state_depressed, 
-                                                      modifier_state_latched,
-                                                      modifier_state_locked, 
-                                                      modifier_state_group);
-                
-                // Send the actual key event with the raw keycode (no conversion needed!)
-                libei_handler->keyboard->send_key(time, keycode, is_press ? 1 : 0);
-                
-                // Send modifiers again after the key event to ensure state consistency
-                libei_handler->keyboard->send_modifiers(modifier_state_depressed, 
-                                                      modifier_state_latched,
-                                                      modifier_state_locked, 
-                                                      modifier_state_group);
-                                                      
-                std::cout << "✅ Key " << keycode << " (" << (is_press ? "pressed" : "released") 
-                         << ") forwarded with modifier state: " << modifier_state_depressed << std::endl;
-            } else {
-                std::cout << "❌ Cannot forward key - missing virtual keyboard!" << std::endl;
-            }
+            LOG_TRACE("⌨️ EIS: Keyboard " << (input.u[1] ? "press" : "release") << " keycode=" << input.u[0]);
+            submit_input(session, input);
             break;
         }
         
         case EIS_EVENT_FRAME:
-            // Frame events group related events together - just log for now
-            std::cout << "📸 EIS: Frame event" << std::endl;
+            // Everything since the previous frame belongs together: send it as
+            // one Wayland pointer frame with a single flush. If only motion is
+            // pending and more events are already queued (a backlog), keep
+            // accumulating so the burst collapses into one update.
+            if (!session.pointer_frame_pending && !session.keyboard_flush_pending && eis_events_queued(session)) {
+                break;
+            }
+            submit_input(session, make_input_event(InputEventType::Frame, session.id, session.event_time));
             break;
             
         default:
-            std::cout << "❓ EIS: Unhandled event type: " << type << std::endl;
+            LOG_DEBUG("❓ EIS: Unhandled event type: " << type);
             break;
     }
 }
 
-void Portal::update_modifier_state(uint32_t keycode, bool is_press) {
-    // EIS uses raw Linux input keycodes (NOT XKB keycodes with +8 offset)
-    // These are the standard Linux input event keycodes
-    bool is_modifier = false;
-    uint32_t modifier_mask = 0;
+void Portal::add_eis_pointer(Session& session) {
+    struct eis_device* pointer = eis_seat_new_device(session.eis_seat);
+    eis_device_configure_name(pointer, "Hyprland Portal Pointer");
+    eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER);
+    eis_device_configure_capability(pointer, EIS_DEVICE_CAP_BUTTON);
+    eis_device_configure_capability(pointer, EIS_DEVICE_CAP_SCROLL);
     
-    switch (keycode) {
-        case 42:  // Shift_L (raw keycode 42)
-        case 54:  // Shift_R (raw keycode 54)
-            is_modifier = true;
-            modifier_mask = MOD_SHIFT;
-            std::cout << "🔧 Detected SHIFT key: " << keycode << std::endl;
+    // One region per monitor, offset from the top-left corner of the layout
+    // (EIS offsets are unsigned, compositor positions may be negative)
+    std::vector<OutputLayout::Output> outputs;
+    OutputLayout::Bounds bounds;
+    if (wayland) {
+        outputs = wayland->get_outputs().outputs();
+        bounds = wayland->get_outputs().bounds();
+    }
+    if (!outputs.empty()) {
+        eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER_ABSOLUTE);
+    }
+    for (const auto& output : outputs) {
+        struct eis_region* region = eis_device_new_region(pointer);
+        eis_region_set_offset(region, static_cast<uint32_t>(output.x - bounds.x),
+                              static_cast<uint32_t>(output.y - bounds.y));
+        eis_region_set_size(region, static_cast<uint32_t>(output.width), static_cast<uint32_t>(output.height));
+        eis_region_set_physical_scale(region, static_cast<double>(output.scale));
+        eis_region_add(region);
+        eis_region_unref(region);
+    }
+    
+    eis_device_add(pointer);
+    eis_device_resume(pointer);
+    session.eis_pointer = pointer;
+    LOG_DEBUG("🖥️ EIS: Pointer added with " << outputs.size() << " region(s) for session " << session.handle);
+}
+
+void Portal::add_eis_keyboard(Session& session) {
+    struct eis_device* keyboard = eis_seat_new_device(session.eis_seat);
+    eis_device_configure_name(keyboard, "Hyprland Portal Keyboard");
+    eis_device_configure_capability(keyboard, EIS_DEVICE_CAP_KEYBOARD);
+    
+    // The compositor's own layout, from the same sealed memfd the virtual
+    // keyboards use; libeis keeps its own copy of the fd
+    if (wayland && wayland->get_keymap().fd() >= 0) {
+        const SharedKeymap& shared = wayland->get_keymap();
+        struct eis_keymap* keymap = eis_device_new_keymap(keyboard, EIS_KEYMAP_TYPE_XKB,
+                                                          shared.fd(), shared.size());
+        if (keymap) {
+            eis_keymap_add(keymap);
+            eis_keymap_unref(keymap);
+        }
+    }
+    
+    eis_device_add(keyboard);
+    eis_device_resume(keyboard);
+    session.eis_keyboard = keyboard;
+}
+
+void Portal::update_eis_regions() {
+    for (auto& [handle, session] : sessions) {
+        if (!session->eis_pointer) continue;
+        
+        // Regions are fixed once a device is added, so the pointer is replaced;
+        // the client sees it removed and a new one appear
+        eis_device_remove(session->eis_pointer);
+        eis_device_unref(session->eis_pointer);
+        session->eis_pointer = nullptr;
+        add_eis_pointer(*session);
+        LOG_INFO("🖥️ EIS: Updated pointer regions for session " << handle);
+    }
+}
+
+void Portal::capture_eis_event(Session& session, struct eis_event* event) {
+    uint32_t id = session.id;
+    switch (eis_event_get_type(event)) {
+        case EIS_EVENT_POINTER_MOTION:
+            capture->record(CaptureSource::Eis, CaptureType::Motion, id,
+                            eis_event_pointer_get_dx(event), eis_event_pointer_get_dy(event));
+            break;
+        case EIS_EVENT_POINTER_MOTION_ABSOLUTE:
+            capture->record(CaptureSource::Eis, CaptureType::MotionAbsolute, id,
+                            eis_event_pointer_get_absolute_x(event), eis_event_pointer_get_absolute_y(event));
+            break;
+        case EIS_EVENT_BUTTON_BUTTON:
+            capture->record(CaptureSource::Eis, CaptureType::Button, id,
+                            eis_event_button_get_button(event), eis_event_button_get_is_press(event));
+            break;
+        case EIS_EVENT_SCROLL_DELTA:
+            capture->record(CaptureSource::Eis, CaptureType::ScrollDelta, id,
+                            eis_event_scroll_get_dx(event), eis_event_scroll_get_dy(event));
+            break;
+        case EIS_EVENT_SCROLL_DISCRETE:
+            capture->record(CaptureSource::Eis, CaptureType::ScrollDiscrete, id,
+                            static_cast<uint32_t>(eis_event_scroll_get_discrete_dx(event)),
+                            static_cast<uint32_t>(eis_event_scroll_get_discrete_dy(event)));
+            break;
+        case EIS_EVENT_SCROLL_STOP:
+        case EIS_EVENT_SCROLL_CANCEL:
+            capture->record(CaptureSource::Eis, CaptureType::ScrollStop, id,
+                            eis_event_scroll_get_stop_x(event), eis_event_scroll_get_stop_y(event),
+                            eis_event_get_type(event) == EIS_EVENT_SCROLL_CANCEL);
+            break;
+        case EIS_EVENT_KEYBOARD_KEY:
+            capture->record(CaptureSource::Eis, CaptureType::Key, id,
+                            eis_event_keyboard_get_key(event), eis_event_keyboard_get_key_is_press(event));
+            break;
+        case EIS_EVENT_FRAME: {
+            CaptureDevice device = eis_event_get_device(event) == session.eis_keyboard
+                ? CaptureDevice::Keyboard : CaptureDevice::Pointer;
+            capture->record(CaptureSource::Eis, CaptureType::Frame, id, static_cast<uint32_t>(device));
+            break;
+        }
+        default:
+            // Connection and device lifecycle is the client's business, not input
+            break;
+    }
+}
+
+void Portal::set_latency_tracker(LatencyTracker* tracker) {
+    latency = tracker;
+    if (libei_session) {
+        libei_session->latency = tracker ? tracker->session(libei_session->handle) : nullptr;
+    }
+}
+
+void Portal::track_latency(Session& session, InputEventKind kind) {
+    session.events_received++;
+    if (!latency || !event_loop) return;
+    
+    latency->dispatched(session.latency, kind, event_loop->wakeup_time_ns(), dispatch_time_ns);
+}
+
+void Portal::begin_dispatch() {
+    if (latency) {
+        dispatch_time_ns = LatencyTracker::now_ns();
+    }
+}
+
+bool Portal::eis_events_queued(Session& session) {
+    // Only the session's own client counts; the others' events don't extend its frame
+    struct eis_event* next = eis_peek_event(eis_context);
+    if (!next) return false;
+    bool own = eis_event_get_client(next) == session.eis_client;
+    eis_event_unref(next);
+    return own;
+}
+
+void Portal::commit_eis_frame(Session& session) {
+    if (output_held(session)) {
+        // Nothing goes out before the queue has drained. A scroll stop still
+        // ends its entry, so scrolling after it isn't merged into the stopped
+        // sequence.
+        const MotionCoalescer* motion = peek_motion(session);
+        if (motion && motion->scroll_stop_pending()) {
+            session.outgoing.push_pointer();
+        }
+        return;
+    }
+    write_eis_frame(session);
+}
+
+void Portal::write_eis_frame(Session& session) {
+    // Deferred motion goes out now, ahead of whatever ended the frame
+    session.motion_deferred = false;
+    // Anything pending was queued on the session's pointer, so it already exists
+    if (!session.eis_motion.empty()) {
+        WaylandVirtualPointer* pointer = session.pointer();
+        if (pointer && session.eis_motion.flush_to(pointer, session.eis_motion_time)) {
+            session.pointer_frame_pending = true;
+        }
+    }
+    
+    if (session.pointer_frame_pending) {
+        if (WaylandVirtualPointer* pointer = session.pointer()) {
+            pointer->send_frame();
+        }
+    }
+    
+    // Every session's devices share one Wayland connection, so a single flush sends both
+    if ((session.pointer_frame_pending || session.keyboard_flush_pending) && wayland) {
+        if (batching) {
+            flush_owed = true;
+        } else {
+            wayland->flush();
+        }
+    }
+    
+    session.pointer_frame_pending = false;
+    session.keyboard_flush_pending = false;
+}
+
+bool Portal::output_held(const Session& session) const {
+    return (wayland && wayland->blocked()) || !session.outgoing.empty();
+}
+
+MotionCoalescer& Portal::pending_motion(Session& session) {
+    // Whatever was merged before the queue started is older than all of it,
+    // so eis_motion only takes input while nothing is queued
+    if (!session.outgoing.empty()) {
+        return session.outgoing.motion(session.event_time);
+    }
+    session.eis_motion_time = session.event_time;
+    return session.eis_motion;
+}
+
+const MotionCoalescer* Portal::peek_motion(const Session& session) const {
+    if (!session.outgoing.empty()) {
+        return session.outgoing.open_motion();
+    }
+    return &session.eis_motion;
+}
+
+uint64_t Portal::receive_time_ns() const {
+    // Everything handled in one wakeup arrived together; one clock read covers it
+    return event_loop ? event_loop->wakeup_time_ns() : LatencyTracker::now_ns();
+}
+
+uint32_t Portal::dbus_event_time(Session& session) {
+    // A batch took its clock reading when it started
+    if (!batching) {
+        begin_dispatch();
+    }
+    // Notify* calls carry no timestamp of their own
+    session.event_time = wayland_time(receive_time_ns());
+    return session.event_time;
+}
+
+bool Portal::notify_pointer_motion(Session& session, double dx, double dy) {
+    if (capture) {
+        capture->record(CaptureSource::DBus, CaptureType::Motion, session.id, dx, dy);
+    }
+    InputEvent input = make_input_event(InputEventType::Motion, session.id, dbus_event_time(session));
+    input.d[0] = dx;
+    input.d[1] = dy;
+    bool sent = submit_input(session, input);
+    end_dbus_event(session);
+    return sent;
+}
+
+bool Portal::notify_pointer_button(Session& session, uint32_t button, uint32_t state) {
+    if (capture) {
+        capture->record(CaptureSource::DBus, CaptureType::Button, session.id, button, state);
+    }
+    InputEvent input = make_input_event(InputEventType::Button, session.id, dbus_event_time(session));
+    input.u[0] = button;
+    input.u[1] = state;
+    bool sent = submit_input(session, input);
+    end_dbus_event(session);
+    return sent;
+}
+
+bool Portal::notify_pointer_axis(Session& session, double dx, double dy, bool finish) {
+    if (capture) {
+        capture->record(CaptureSource::DBus, CaptureType::ScrollDelta, session.id, dx, dy);
+        if (finish) {
+            capture->record(CaptureSource::DBus, CaptureType::ScrollStop, session.id, 1u, 1u);
+        }
+    }
+    // Clients that end their sequences with "finish" scroll like a finger
+    // on a touchpad, kinetic scrolling included. Others never send a stop,
+    // so their scroll is continuous and nothing waits for one.
+    session.dbus_scroll_finishes |= finish;
+    InputEvent input = make_input_event(InputEventType::ScrollDelta, session.id, dbus_event_time(session));
+    input.d[0] = dx;
+    input.d[1] = dy;
+    if (!session.dbus_scroll_finishes) {
+        input.flags = INPUT_SCROLL_CONTINUOUS;
+    }
+    bool sent = submit_input(session, input);
+    if (finish) {
+        InputEvent stop = make_input_event(InputEventType::ScrollStop, session.id, session.event_time);
+        stop.u[0] = 1;
+        stop.u[1] = 1;
+        submit_input(session, stop);
+    }
+    end_dbus_event(session);
+    return sent;
+}
+
+bool Portal::notify_pointer_axis_discrete(Session& session, uint32_t axis, int32_t steps) {
+    // Whole wheel notches, on the same scale as EIS value120
+    bool horizontal = axis == WL_POINTER_AXIS_HORIZONTAL_SCROLL;
+    InputEvent input = make_input_event(InputEventType::ScrollDiscrete, session.id, dbus_event_time(session));
+    input.i[0] = horizontal ? steps * 120 : 0;
+    input.i[1] = horizontal ? 0 : steps * 120;
+    if (capture) {
+        capture->record(CaptureSource::DBus, CaptureType::ScrollDiscrete, session.id, input.u[0], input.u[1]);
+    }
+    bool sent = submit_input(session, input);
+    end_dbus_event(session);
+    return sent;
+}
+
+bool Portal::notify_keyboard_keycode(Session& session, uint32_t keycode, uint32_t state) {
+    if (capture) {
+        capture->record(CaptureSource::DBus, CaptureType::Key, session.id, keycode, state);
+    }
+    InputEvent input = make_input_event(InputEventType::Key, session.id, dbus_event_time(session));
+    input.u[0] = keycode;
+    input.u[1] = state;
+    bool sent = submit_input(session, input);
+    end_dbus_event(session);
+    return sent;
+}
+
+bool Portal::notify_keyboard_keysym(Session& session, uint32_t keysym, uint32_t state) {
+    if (capture) {
+        capture->record(CaptureSource::DBus, CaptureType::Keysym, session.id, keysym, state);
+    }
+    // Look up the key (and the modifiers it needs) in the prebuilt index
+    const KeysymIndex::Entry* entry = keysym_index.lookup(static_cast<xkb_keysym_t>(keysym));
+    if (!entry) {
+        LOG_DEBUG("  Failed to find keycode for keysym " << keysym);
+        input_stats.dropped++;
+        return false;
+    }
+    InputEvent input = make_input_event(InputEventType::Key, session.id, dbus_event_time(session));
+    input.u[0] = entry->keycode;
+    input.u[1] = state;
+    // E.g. Shift for uppercase
+    input.u[2] = entry->mods;
+    bool sent = submit_input(session, input);
+    end_dbus_event(session);
+    return sent;
+}
+
+uint32_t Portal::notify_input_batch(Session& session, const std::vector<BatchEvent>& events) {
+    uint32_t applied = 0;
+    begin_dispatch();
+    batching = true;
+    for (const auto& event : events) {
+        uint32_t type = std::get<0>(event);
+        uint32_t code = std::get<1>(event);
+        double x = std::get<2>(event);
+        double y = std::get<3>(event);
+        uint32_t state = std::get<4>(event);
+        // Only events that reached a device count as applied
+        bool sent = false;
+        switch (static_cast<BatchEventType>(type)) {
+            case BatchEventType::PointerMotion:
+                sent = notify_pointer_motion(session, x, y);
+                break;
+            case BatchEventType::PointerButton:
+                sent = notify_pointer_button(session, code, state);
+                break;
+            case BatchEventType::PointerAxis:
+                sent = notify_pointer_axis(session, x, y, state != 0);
+                break;
+            case BatchEventType::PointerAxisDiscrete:
+                if (x != 0) {
+                    sent |= notify_pointer_axis_discrete(session, WL_POINTER_AXIS_HORIZONTAL_SCROLL, static_cast<int32_t>(x));
+                }
+                if (y != 0) {
+                    sent |= notify_pointer_axis_discrete(session, WL_POINTER_AXIS_VERTICAL_SCROLL, static_cast<int32_t>(y));
+                }
+                break;
+            case BatchEventType::KeyboardKeycode:
+                sent = notify_keyboard_keycode(session, code, state);
+                break;
+            case BatchEventType::KeyboardKeysym:
+                sent = notify_keyboard_keysym(session, code, state);
+                break;
+            default:
+                LOG_DEBUG("  Skipping batch event of unknown type " << type);
+                break;
+        }
+        if (sent) {
+            applied++;
+        }
+    }
+    
+    // Whatever the batch left pending goes out in its single flush
+    submit_input(session, make_input_event(InputEventType::Frame, session.id, session.event_time));
+    batching = false;
+    if (flush_owed && wayland) {
+        wayland->flush();
+    }
+    flush_owed = false;
+    return applied;
+}
+
+void Portal::end_dbus_event(Session& session) {
+    // A batch merges its motion and sends everything together at the end
+    if (!batching) {
+        submit_input(session, make_input_event(InputEventType::Frame, session.id, session.event_time));
+    }
+}
+
+void Portal::submit_libei_input(const std::vector<InputEvent>& events) {
+    Session& session = *libei_session;
+    begin_dispatch();
+    for (const InputEvent& event : events) {
+        submit_input(session, event);
+    }
+    // Like an EIS client that didn't end its batch with a frame
+    commit_eis_frame(session);
+    
+    // The receiver has already read these; stop it reading more instead
+    if (session.outgoing.size() >= max_queued) {
+        pause_input(session);
+    }
+}
+
+bool Portal::submit_input(Session& session, const InputEvent& event) {
+    session.event_time = event.time;
+    InputStats& stats = session.id == 0 ? libei_input_stats : input_stats;
+    stats.received[static_cast<size_t>(event.type)]++;
+    
+    // The compositor refused the device this needs
+    bool pointer_event = event.type != InputEventType::Key && event.type != InputEventType::Frame;
+    if (pointer_event && !session.pointer()) {
+        stats.dropped++;
+        return false;
+    }
+    if (event.type == InputEventType::Key && !session.keyboard()) {
+        LOG_WARN("❌ Cannot forward key - missing virtual keyboard!");
+        stats.dropped++;
+        return false;
+    }
+    
+    switch (event.type) {
+        case InputEventType::Motion:
+            if (session.pointer()) {
+                pending_motion(session).add_motion(event.d[0], event.d[1]);
+                track_latency(session, InputEventKind::PointerMotion);
+            }
             break;
             
-        case 29:  // Control_L (raw keycode 29)
-        case 97:  // Control_R (raw keycode 97)
-            is_modifier = true;
-            modifier_mask = MOD_CTRL;
-            std::cout << "🔧 Detected CTRL key: " << keycode << std::endl;
+        case InputEventType::MotionAbsolute:
+            if (session.pointer()) {
+                pending_motion(session).add_motion_absolute(event.u[0], event.u[1], event.u[2], event.u[3]);
+                track_latency(session, InputEventKind::PointerMotionAbsolute);
+            }
             break;
             
-        case 56:  // Alt_L (raw keycode 56)
-        case 100: // Alt_R (raw keycode 100)
-            is_modifier = true;
-            modifier_mask = MOD_ALT;
-            std::cout << "🔧 Detected ALT key: " << keycode << std::endl;
+        case InputEventType::Button:
+            if (session.pointer()) {
+                emit_button(session, event.time, event.u[0], event.u[1]);
+                session.set_button_state(event.u[0], event.u[1] != 0);
+                track_latency(session, InputEventKind::PointerButton);
+            }
             break;
             
-        case 125: // Super_L (raw keycode 125) - Meta/Windows key
-        case 126: // Super_R (raw keycode 126)
-            is_modifier = true;
-            modifier_mask = MOD_META;
-            std::cout << "🔧 Detected META/SUPER key: " << keycode << std::endl;
+        case InputEventType::ScrollDelta:
+        case InputEventType::ScrollDiscrete:
+            if (event.type == InputEventType::ScrollDiscrete && event.i[0] == 0 && event.i[1] == 0) {
+                break;
+            }
+            // Combined per axis with any other scroll before the next frame,
+            // unless the sequence it would join has already stopped
+            if (session.pointer()) {
+                const MotionCoalescer* motion = peek_motion(session);
+                if (motion && motion->scroll_stop_pending()) {
+                    commit_eis_frame(session);
+                }
+                if (event.type == InputEventType::ScrollDelta) {
+                    pending_motion(session).add_scroll(event.d[0], event.d[1],
+                                                       !(event.flags & INPUT_SCROLL_CONTINUOUS));
+                } else {
+                    // In 120ths of a notch; fractions carry over until they add up
+                    pending_motion(session).add_scroll_discrete(event.i[0], event.i[1]);
+                }
+                track_latency(session, InputEventKind::PointerScroll);
+            }
             break;
             
-        case 58:  // Caps_Lock (raw keycode 58)
-            // Caps lock is special - toggle on press only
-            if (is_press) {
-                modifier_state_locked ^= MOD_CAPS; // Toggle caps lock state
-                std::cout << "🔒 Caps Lock toggled: " << (modifier_state_locked & MOD_CAPS ? "ON" : "OFF") << std::endl;
+        case InputEventType::ScrollStop:
+            if (session.pointer()) {
+                pending_motion(session).add_scroll_stop(event.u[0] != 0, event.u[1] != 0);
             }
-            return;
+            break;
+            
+        case InputEventType::Key: {
+            // Keys are ordering barriers: pointer input queued before them goes out first
+            commit_eis_frame(session);
             
-        case 69:  // Num_Lock (raw keycode 69)
-            // Num lock is special - toggle on press only
-            if (is_press) {
-                modifier_state_locked ^= MOD_NUM; // Toggle num lock state
-                std::cout << "🔢 Num Lock toggled: " << (modifier_state_locked & MOD_NUM ? "ON" : "OFF") << std::endl;
+            uint32_t key = event.u[0];
+            uint32_t state = event.u[1];
+            // Modifiers the key needs that aren't held already are held while pressing
+            uint32_t mods = event.u[2];
+            bool extra_mods = (mods & ~session.modifier_state_depressed) != 0;
+            if (extra_mods && state) {
+                emit_modifiers(session, session.modifier_state_depressed | mods,
+                               session.modifier_state_latched,
+                               session.modifier_state_locked,
+                               session.modifier_state_group);
             }
-            return;
+            emit_key(session, event.time, key, state);
+            // Followed by the new modifier state, as a real keyboard would,
+            // but only if this key changed it
+            bool changed = session.update_modifier_state(key, state != 0);
+            if (changed || (extra_mods && !state)) {
+                emit_modifier_state(session);
+            }
+            session.set_key_state(key, state != 0);
+            track_latency(session, InputEventKind::KeyboardKey);
+            break;
+        }
+            
+        case InputEventType::Frame:
+            if (!defer_motion(session)) {
+                commit_eis_frame(session);
+            }
+            break;
+    }
+    return true;
+}
+
+bool Portal::defer_motion(Session& session) {
+    if (!frame_clock.attached()) return false;
+    // Only frames with nothing but motion and scroll in them wait; the
+    // stalled-compositor path keeps queueing as before
+    if (session.eis_motion.empty() || session.eis_motion.scroll_stop_pending() ||
+        session.pointer_frame_pending || session.keyboard_flush_pending || output_held(session)) {
+        return false;
+    }
+    session.motion_deferred = true;
+    if (wayland) {
+        frame_clock.set_refresh(wayland->get_outputs().max_refresh());
+    }
+    frame_clock.schedule();
+    return true;
+}
+
+void Portal::send_deferred_motion() {
+    // All sessions' motion goes out with one flush
+    batching = true;
+    for (auto& [handle, session] : sessions) {
+        if (session->motion_deferred) {
+            session->motion_deferred = false;
+            commit_eis_frame(*session);
+        }
+    }
+    if (libei_session && libei_session->motion_deferred) {
+        libei_session->motion_deferred = false;
+        commit_eis_frame(*libei_session);
+    }
+    batching = false;
+    if (flush_owed && wayland) {
+        wayland->flush();
+    }
+    flush_owed = false;
+}
+
+void Portal::emit_button(Session& session, uint32_t time, uint32_t button, uint32_t state) {
+    if (output_held(session)) {
+        session.outgoing.push_button(time, button, state);
+        entry_queued(session);
+        return;
     }
     
-    if (is_modifier) {
-        if (is_press) {
-            modifier_state_depressed |= modifier_mask;
-            std::cout << "🔧 Modifier pressed: " << modifier_mask << " (state: " << modifier_state_depressed << ")" << std::endl;
-        } else {
-            modifier_state_depressed &= ~modifier_mask;
-            std::cout << "🔧 Modifier released: " << modifier_mask << " (state: " << modifier_state_depressed << ")" << std::endl;
+    WaylandVirtualPointer* pointer = session.pointer();
+    if (!pointer) return;
+    // Buttons are ordering barriers: motion queued before them goes out first
+    session.eis_motion.flush_to(pointer, time);
+    pointer->send_button(time, button, state);
+    session.pointer_frame_pending = true;
+}
+
+void Portal::emit_key(Session& session, uint32_t time, uint32_t key, uint32_t state) {
+    if (output_held(session)) {
+        session.outgoing.push_key(time, key, state);
+        entry_queued(session);
+        return;
+    }
+    
+    if (WaylandVirtualKeyboard* keyboard = session.keyboard()) {
+        keyboard->send_key(time, key, state);
+        session.keyboard_flush_pending = true;
+    }
+}
+
+void Portal::emit_modifiers(Session& session, uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group) {
+    if (output_held(session)) {
+        session.outgoing.push_modifiers(depressed, latched, locked, group);
+        entry_queued(session);
+        return;
+    }
+    
+    if (WaylandVirtualKeyboard* keyboard = session.keyboard()) {
+        keyboard->send_modifiers(depressed, latched, locked, group);
+        session.keyboard_flush_pending = true;
+    }
+}
+
+void Portal::emit_modifier_state(Session& session) {
+    emit_modifiers(session, session.modifier_state_depressed,
+                   session.modifier_state_latched,
+                   session.modifier_state_locked,
+                   session.modifier_state_group);
+}
+
+void Portal::entry_queued(Session& session) {
+    queue_stats.queued++;
+    uint64_t depth = session.outgoing.size();
+    queue_stats.max_depth = std::max(queue_stats.max_depth, depth);
+    // EIS clients are paused before this; D-Bus callers can't be, and their
+    // keys and buttons are kept all the same
+    if (depth > max_queued) {
+        queue_stats.overflowed++;
+    }
+}
+
+// Most one queued entry can put into libwayland's 4 KiB client buffer, from
+// the wire size of each request it may turn into (8 byte header, 4 bytes per
+// argument). A pointer entry can be motion_absolute, motion, axis_source,
+// axis_discrete and axis_stop on both axes, and a frame.
+static size_t wire_size(const OutgoingQueue::Entry& entry) {
+    switch (entry.type) {
+        case OutgoingQueue::Entry::Type::Pointer: return 28 + 20 + 12 + 2 * (24 + 16) + 8;
+        case OutgoingQueue::Entry::Type::Button: return 20 + 8;
+        case OutgoingQueue::Entry::Type::Key: return 20;
+        case OutgoingQueue::Entry::Type::Modifiers: return 24;
+    }
+    return 0;
+}
+
+void Portal::drain_outgoing() {
+    for (auto& [handle, session] : sessions) {
+        drain_outgoing(*session);
+    }
+    // Closed sessions may still owe the compositor their releases
+    for (auto& session : closed_sessions) {
+        drain_outgoing(*session);
+    }
+    if (libei_session) {
+        drain_outgoing(*libei_session);
+    }
+}
+
+void Portal::drain_outgoing(Session& session) {
+    // Flush well before the client buffer could fill: a compositor that is
+    // still slow would otherwise overflow it, which libwayland treats as a
+    // broken connection. It also finds out early if the compositor stalls again.
+    constexpr size_t DRAIN_FLUSH_BYTES = 1024;
+    
+    if (!wayland || wayland->blocked()) return;
+    
+    size_t count = 0;
+    size_t unflushed = 0;
+    // What was merged before the stall is older than anything queued
+    write_eis_frame(session);
+    
+    while (!session.outgoing.empty() && !wayland->blocked()) {
+        OutgoingQueue::Entry& entry = session.outgoing.front();
+        unflushed += wire_size(entry);
+        switch (entry.type) {
+            case OutgoingQueue::Entry::Type::Pointer:
+                if (WaylandVirtualPointer* pointer = session.pointer()) {
+                    // Merged into eis_motion so the fractional carry stays with the session
+                    session.eis_motion.merge(entry.motion);
+                    if (session.eis_motion.flush_to(pointer, entry.time)) {
+                        pointer->send_frame();
+                    }
+                }
+                break;
+            case OutgoingQueue::Entry::Type::Button:
+                if (WaylandVirtualPointer* pointer = session.pointer()) {
+                    pointer->send_button(entry.time, entry.args[0], entry.args[1]);
+                    pointer->send_frame();
+                }
+                break;
+            case OutgoingQueue::Entry::Type::Key:
+                if (WaylandVirtualKeyboard* keyboard = session.keyboard()) {
+                    keyboard->send_key(entry.time, entry.args[0], entry.args[1]);
+                }
+                break;
+            case OutgoingQueue::Entry::Type::Modifiers:
+                if (WaylandVirtualKeyboard* keyboard = session.keyboard()) {
+                    keyboard->send_modifiers(entry.args[0], entry.args[1], entry.args[2], entry.args[3]);
+                }
+                break;
         }
-    } else {
-        std::cout << "🔍 Non-modifier key: " << keycode << std::endl;
+        session.outgoing.pop();
+        count++;
+        if (unflushed >= DRAIN_FLUSH_BYTES) {
+            wayland->flush();
+            unflushed = 0;
+        }
+    }
+    
+    if (count > 0) {
+        wayland->flush();
+        LOG_DEBUG("⏳ Sent " << count << " queued entries for session " << session.handle
+                  << " (" << session.outgoing.size() << " left)");
     }
-} 
\ No newline at end of file
+    
+    if (session.eis_paused && session.outgoing.size() < max_queued) {
+        resume_input(session);
+    }
+}
+
+void Portal::pause_input(Session& session) {
+    if (session.eis_paused) return;
+    
+    session.eis_paused = true;
+    queue_stats.paused++;
+    if (&session == libei_session.get()) {
+        libei_handler->set_reading(false);
+    } else if (!eis_reading_paused && eis_context) {
+        // Every client shares the EIS fd. Whatever filled this queue stalled
+        // the compositor for all of them, so they all wait.
+        eis_reading_paused = true;
+        if (event_loop) {
+            event_loop->modify_fd(eis_get_fd(eis_context), 0);
+        }
+    }
+    LOG_DEBUG("⏳ Queue full, no longer reading client of session " << session.handle);
+}
+
+void Portal::resume_input(Session& session) {
+    session.eis_paused = false;
+    if (&session == libei_session.get()) {
+        // It handed over everything it read; the rest is still on its socket
+        libei_handler->set_reading(true);
+        return;
+    }
+    if (!eis_reading_paused) return;
+    for (const auto& [handle, other] : sessions) {
+        if (other->eis_paused) return;
+    }
+    
+    eis_reading_paused = false;
+    if (event_loop) {
+        event_loop->modify_fd(eis_get_fd(eis_context), EPOLLIN);
+    }
+    // Pick up where dispatching stopped; libeis still holds those events
+    dispatch_eis();
+}
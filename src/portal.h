@@ -1,51 +1,212 @@
 #pragma once
 
 #include <sdbus-c++/sdbus-c++.h>
+#include <deque>
+#include <map>
 #include <memory>
+#include <vector>
+#include "frame_clock.h"
+#include "input_event.h"
+#include "keysym_index.h"
+#include "latency_stats.h"
+#include "session.h"
 
 extern "C" {
 #include "libei-1.0/libeis.h"
 }
 
 class LibEIHandler;
+class EventLoop;
+class InputCapture;
+class WaylandConnection;
+
+// Event types of the Input interface's NotifyInputBatch. Each event is a
+// (type, code, x, y, state) struct; fields a type doesn't use are ignored.
+enum class BatchEventType : uint32_t {
+    PointerMotion = 0,          // x, y: relative motion
+    PointerButton = 1,          // code: evdev button, state: 1 pressed, 0 released
+    PointerAxis = 2,            // x, y: smooth scroll; state: nonzero ends the sequence
+    PointerAxisDiscrete = 3,    // x, y: whole wheel notches
+    KeyboardKeycode = 4,        // code: evdev keycode, state
+    KeyboardKeysym = 5,         // code: keysym, state
+};
+using BatchEvent = sdbus::Struct<uint32_t, uint32_t, double, double, uint32_t>;
 
 class Portal {
 public:
     Portal();
     ~Portal();
     
-    bool init(LibEIHandler* handler);
+    // Sessions create their virtual devices on the given connection
+    bool init(LibEIHandler* handler, WaylandConnection* conn);
     void cleanup();
-    void run();
-    void stop();
-    void setVerbose(bool verbose);
+    // Register the D-Bus and EIS file descriptors with the event loop
+    bool attach(EventLoop& loop);
+    
+    // Receives per-event latencies; also served over the Stats D-Bus interface
+    void set_latency_tracker(LatencyTracker* tracker);
+    // Entries a session may queue while the compositor is stalled before
+    // its EIS client stops being read
+    void set_max_queued(size_t limit) { max_queued = limit; }
+    // Record EIS events and D-Bus Notify* calls as they are handled
+    void set_capture(InputCapture* recorder) { capture = recorder; }
+    // What the input thread runs with, as reported over the Stats interface
+    void set_input_scheduling(const std::string& description) { input_scheduling = description; }
+    // Send motion once per output refresh rather than with every client frame;
+    // must be set before attach()
+    void set_motion_resampling(bool enabled) { resample_motion = enabled; }
+    // steady_clock time the process started; the first CreateSession logs how long it took
+    void set_start_time(uint64_t ns) { start_time_ns = ns; }
+    
+    // No sessions, live or still draining: nothing would be lost by exiting
+    bool idle() const;
+    // Give up the bus name ahead of an idle exit
+    void release_name();
     
 private:
     std::unique_ptr<sdbus::IConnection> connection;
     std::unique_ptr<sdbus::IObject> object;
     LibEIHandler* libei_handler;
-    bool running;
-    bool verbose;
+    WaylandConnection* wayland;
+    EventLoop* event_loop;
+    
+    // Live sessions by session handle; closed ones wait in closed_sessions
+    // until the current dispatch is over so their D-Bus object can go safely
+    std::map<std::string, std::unique_ptr<Session>> sessions;
+    std::vector<std::unique_ptr<Session>> closed_sessions;
+    // The libei receiver's input goes out on a session of its own (id 0),
+    // which lives as long as the portal and has no D-Bus object
+    std::unique_ptr<Session> libei_session;
+    void submit_libei_input(const std::vector<InputEvent>& events);
+    
+    // Look up a session, creating it (and its D-Bus object) for unknown handles
+    Session& session_for(const std::string& handle, const std::string& app_id = "");
+    void close_session(const std::string& handle);
+    // Let go of every key and button the session still holds down
+    void release_input(Session& session);
+    
+    // RemoteDesktop Notify* calls, one event each, and NotifyInputBatch.
+    // False when the event could not be forwarded (no device, unknown keysym).
+    bool notify_pointer_motion(Session& session, double dx, double dy);
+    bool notify_pointer_button(Session& session, uint32_t button, uint32_t state);
+    bool notify_pointer_axis(Session& session, double dx, double dy, bool finish);
+    bool notify_pointer_axis_discrete(Session& session, uint32_t axis, int32_t steps);
+    bool notify_keyboard_keycode(Session& session, uint32_t keycode, uint32_t state);
+    bool notify_keyboard_keysym(Session& session, uint32_t keysym, uint32_t state);
+    uint32_t notify_input_batch(Session& session, const std::vector<BatchEvent>& events);
+    void end_dbus_event(Session& session);
     
-    // Modifier state tracking for proper key combination handling
-    uint32_t modifier_state_depressed = 0;
-    uint32_t modifier_state_latched = 0;
-    uint32_t modifier_state_locked = 0;
-    uint32_t modifier_state_group = 0;
+    // The one consumer of every frontend's input: the only place that
+    // decides what a session's virtual devices are sent. False when the
+    // device the event needs doesn't exist.
+    bool submit_input(Session& session, const InputEvent& event);
+    // Inside NotifyInputBatch: Wayland flushes wait for the end of the batch
+    bool batching = false;
+    bool flush_owed = false;
     
-    // XKB modifier masks for common modifiers
-    static constexpr uint32_t MOD_SHIFT = 1 << 0;
-    static constexpr uint32_t MOD_CAPS = 1 << 1;
-    static constexpr uint32_t MOD_CTRL = 1 << 2;
-    static constexpr uint32_t MOD_ALT = 1 << 3;
-    static constexpr uint32_t MOD_NUM = 1 << 4;
-    static constexpr uint32_t MOD_META = 1 << 6; // Super/Windows key
+    // Motion resampling: a frame that only moved the pointer leaves its
+    // motion merging until the frame clock ticks. Buttons, keys and scroll
+    // stops still go out at once, after the motion before them.
+    bool resample_motion = false;
+    FrameClock frame_clock;
+    bool defer_motion(Session& session);
+    // Tick: send the motion every session merged since the last one
+    void send_deferred_motion();
     
-    void update_modifier_state(uint32_t keycode, bool is_press);
+    // Resolves NotifyKeyboardKeysym requests against the shared keymap
+    KeysymIndex keysym_index;
+    
+    bool setup_keymap();
+    // The compositor's layout changed: re-index it and hand it to EIS clients
+    void update_keymap();
+    // One EIS server serves every session's client; each client is mapped
+    // to its session through its user data when it connects
+    struct eis* eis_context = nullptr;
+    // Sessions that were handed a client fd, in ConnectToEIS order; the
+    // next client to connect belongs to the front one
+    std::deque<std::string> eis_pending_sessions;
+    // The shared EIS fd isn't being read because a session's queue is full
+    bool eis_reading_paused = false;
+    bool setup_eis();
+    void dispatch_eis();
+    // The session an event's client belongs to; nullptr once it has closed
+    Session* eis_session(struct eis_event* event) const;
+    // Assign a newly connected client to the oldest session waiting for one
+    Session* claim_eis_client(struct eis_client* client);
+    // Add the session's EIS pointer with one region per monitor
+    void add_eis_pointer(Session& session);
+    void add_eis_keyboard(Session& session);
+    // Replace every session's EIS pointer after the monitor layout changed
+    void update_eis_regions();
+    
+    // Let sd-bus handle everything it has pending and re-arm its fd/timeout
+    void process_dbus();
+    int prepare_dbus();
     
     // Modern EIS (Emulated Input Server) method implementation
     sdbus::UnixFd ConnectToEIS(sdbus::ObjectPath session_handle, std::string app_id, std::map<std::string, sdbus::Variant> options);
     
     // EIS event handling
-    void handle_eis_event(struct eis_event* event);
+    void handle_eis_event(Session& session, struct eis_event* event);
+    // Send everything queued since the session's last EIS frame
+    void commit_eis_frame(Session& session);
+    void write_eis_frame(Session& session);
+    bool eis_events_queued(Session& session);
+    
+    // Input is written straight to the session's devices unless the
+    // compositor is stalled or older input is still queued; then it joins
+    // the session's outgoing queue
+    bool output_held(const Session& session) const;
+    MotionCoalescer& pending_motion(Session& session);
+    // Where pending_motion() would put input, for queries: never opens a
+    // queue entry or moves eis_motion_time. nullptr if nothing is pending there.
+    const MotionCoalescer* peek_motion(const Session& session) const;
+    // Arrival time of the input being handled: one clock read per wakeup
+    uint64_t receive_time_ns() const;
+    // Stamp D-Bus input with its arrival time, as Wayland time
+    uint32_t dbus_event_time(Session& session);
+    void emit_button(Session& session, uint32_t time, uint32_t button, uint32_t state);
+    void emit_key(Session& session, uint32_t time, uint32_t key, uint32_t state);
+    void emit_modifiers(Session& session, uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group);
+    void emit_modifier_state(Session& session);
+    void entry_queued(Session& session);
+    // The compositor caught up: replay what the sessions queued meanwhile
+    void drain_outgoing();
+    void drain_outgoing(Session& session);
+    void pause_input(Session& session);
+    void resume_input(Session& session);
+    
+    size_t max_queued = 1024;
+    // Backpressure counters, served over the Stats D-Bus interface
+    struct QueueStats {
+        uint64_t queued = 0;        // entries that had to wait for the compositor
+        uint64_t overflowed = 0;    // queued past max_queued (D-Bus input can't be paused)
+        uint64_t paused = 0;        // times an EIS client stopped being read
+        uint64_t max_depth = 0;     // longest a session's queue got
+        uint64_t coalesced = 0;     // motion and scroll of closed sessions merged away
+    };
+    QueueStats queue_stats;
+    // Input by type as it reaches submit_input(), and input that could not
+    // be forwarded at all (no device, no output geometry, unknown keysym)
+    struct InputStats {
+        uint64_t received[INPUT_EVENT_TYPE_COUNT] = {};
+        uint64_t dropped = 0;
+    };
+    InputStats input_stats;
+    InputStats libei_input_stats;
+    // Counters and gauges of every component, in Prometheus text format
+    std::string metrics_text() const;
+    
+    LatencyTracker* latency = nullptr;
+    std::string input_scheduling = "SCHED_OTHER";
+    uint64_t start_time_ns = 0;
+    void track_latency(Session& session, InputEventKind kind);
+    // When the input being handled started dispatching: one clock read per
+    // EIS dispatch, D-Bus call or NotifyInputBatch, shared by its events
+    uint64_t dispatch_time_ns = 0;
+    void begin_dispatch();
+    
+    InputCapture* capture = nullptr;
+    uint32_t last_session_id = 0;
+    void capture_eis_event(Session& session, struct eis_event* event);
 };  
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "session.h"
+#include "logger.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include "wayland_connection.h"
+
+Session::Session(std::string handle, std::string app_id, WaylandConnection* wayland)
+    : handle(std::move(handle)), app_id(std::move(app_id)), wayland(wayland) {
+}
+
+Session::~Session() {
+    disconnect_eis();
+    if (xkb_state) {
+        xkb_state_unref(xkb_state);
+    }
+    // Destroying the devices queues their destroy requests; Portal flushes them
+    virtual_keyboard.reset();
+    virtual_pointer.reset();
+    object.reset();
+}
+
+WaylandVirtualPointer* Session::pointer() {
+    if (!virtual_pointer && !pointer_failed && wayland) {
+        auto device = std::make_unique<WaylandVirtualPointer>();
+        if (device->init(wayland)) {
+            LOG_DEBUG("🖱️ Created virtual pointer for session " << handle);
+            device->set_capture_session(id);
+            virtual_pointer = std::move(device);
+        } else {
+            LOG_ERROR("❌ Failed to create virtual pointer for session " << handle);
+            pointer_failed = true;
+        }
+    }
+    return virtual_pointer.get();
+}
+
+WaylandVirtualKeyboard* Session::keyboard() {
+    if (!virtual_keyboard && !keyboard_failed && wayland) {
+        auto device = std::make_unique<WaylandVirtualKeyboard>();
+        if (device->init(wayland)) {
+            LOG_DEBUG("⌨️ Created virtual keyboard for session " << handle);
+            device->set_capture_session(id);
+            virtual_keyboard = std::move(device);
+        } else {
+            LOG_ERROR("❌ Failed to create virtual keyboard for session " << handle);
+            keyboard_failed = true;
+        }
+    }
+    return virtual_keyboard.get();
+}
+
+void Session::disconnect_eis() {
+    drop_eis_devices();
+    if (eis_client) {
+        // Its remaining events are dropped rather than sent to a session that's gone
+        eis_client_set_user_data(eis_client, nullptr);
+        eis_client_disconnect(eis_client);
+        eis_client_unref(eis_client);
+        eis_client = nullptr;
+    }
+}
+
+void Session::drop_eis_devices() {
+    if (eis_keyboard) {
+        eis_device_unref(eis_keyboard);
+        eis_keyboard = nullptr;
+    }
+    if (eis_pointer) {
+        eis_device_unref(eis_pointer);
+        eis_pointer = nullptr;
+    }
+    if (eis_seat) {
+        eis_seat_unref(eis_seat);
+        eis_seat = nullptr;
+    }
+}
+
+void Session::set_key_state(uint32_t keycode, bool pressed) {
+    if (pressed) {
+        pressed_keys.insert(keycode);
+    } else {
+        pressed_keys.erase(keycode);
+    }
+}
+
+void Session::set_button_state(uint32_t button, bool pressed) {
+    if (pressed) {
+        pressed_buttons.insert(button);
+    } else {
+        pressed_buttons.erase(button);
+    }
+}
+
+bool Session::ensure_xkb_state() {
+    if (!wayland) return false;
+    const SharedKeymap& shared = wayland->get_keymap();
+    if (!shared.keymap()) return false;
+    if (xkb_state && xkb_state_generation == shared.generation()) return true;
+
+    // New layout (or a reset): start a fresh state, carrying over locks, the
+    // active group and held keys
+    if (xkb_state) {
+        xkb_state_unref(xkb_state);
+    }
+    xkb_state = xkb_state_new(shared.keymap());
+    if (!xkb_state) {
+        LOG_ERROR("Failed to create XKB state for session " << handle);
+        return false;
+    }
+    xkb_state_generation = shared.generation();
+    xkb_state_update_mask(xkb_state, 0, 0, modifier_state_locked, 0, 0, modifier_state_group);
+    for (uint32_t key : pressed_keys) {
+        xkb_state_update_key(xkb_state, key + 8, XKB_KEY_DOWN);
+    }
+    return true;
+}
+
+bool Session::serialize_modifiers() {
+    uint32_t depressed = xkb_state_serialize_mods(xkb_state, XKB_STATE_MODS_DEPRESSED);
+    uint32_t latched = xkb_state_serialize_mods(xkb_state, XKB_STATE_MODS_LATCHED);
+    uint32_t locked = xkb_state_serialize_mods(xkb_state, XKB_STATE_MODS_LOCKED);
+    uint32_t group = xkb_state_serialize_layout(xkb_state, XKB_STATE_LAYOUT_EFFECTIVE);
+    if (depressed == modifier_state_depressed && latched == modifier_state_latched &&
+        locked == modifier_state_locked && group == modifier_state_group) {
+        return false;
+    }
+
+    modifier_state_depressed = depressed;
+    modifier_state_latched = latched;
+    modifier_state_locked = locked;
+    modifier_state_group = group;
+    LOG_TRACE("🔧 Modifiers: depressed=" << depressed << " latched=" << latched
+              << " locked=" << locked << " group=" << group);
+    return true;
+}
+
+bool Session::update_modifier_state(uint32_t keycode, bool is_press) {
+    if (!ensure_xkb_state()) return false;
+
+    // EIS and the portal use evdev keycodes; XKB ones are offset by 8
+    xkb_state_update_key(xkb_state, keycode + 8, is_press ? XKB_KEY_DOWN : XKB_KEY_UP);
+    return serialize_modifiers();
+}
+
+bool Session::release_modifiers() {
+    // Rebuilt from the locks and whatever is still in pressed_keys
+    xkb_state_generation = 0;
+    if (!ensure_xkb_state()) return false;
+    return serialize_modifiers();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <sdbus-c++/sdbus-c++.h>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <xkbcommon/xkbcommon.h>
+#include "client_clock.h"
+#include "motion_coalescer.h"
+#include "outgoing_queue.h"
+
+extern "C" {
+#include "libei-1.0/libeis.h"
+}
+
+struct LatencySet;
+class WaylandConnection;
+class WaylandVirtualKeyboard;
+class WaylandVirtualPointer;
+
+// One RemoteDesktop session, keyed by its session handle. Everything that used
+// to be shared between clients lives here: the EIS client that connected for
+// it, the virtual devices it drives, the modifier and pressed-key state,
+// pending EIS frame contents and stats.
+class Session {
+public:
+    enum class State {
+        Created,
+        DevicesSelected,
+        Started,
+        Closed
+    };
+
+    Session(std::string handle, std::string app_id, WaylandConnection* wayland);
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    const std::string handle;
+    std::string app_id;
+    // Short number for the session, unique for the daemon's lifetime (input captures)
+    uint32_t id = 0;
+    State state = State::Created;
+    uint32_t device_types = 0;
+
+    // org.freedesktop.impl.portal.Session object at the session handle
+    std::unique_ptr<sdbus::IObject> object;
+
+    // The client that connected through the fd ConnectToEIS handed out; its
+    // user data points back at this session
+    struct eis_client* eis_client = nullptr;
+    // The seat the client bound and the devices on it, kept so they can be
+    // re-added when monitors or the keyboard layout change
+    struct eis_seat* eis_seat = nullptr;
+    struct eis_device* eis_pointer = nullptr;
+    struct eis_device* eis_keyboard = nullptr;
+
+    // This session's own virtual pointer and keyboard, created on first use so
+    // one client's frames, keymap and held keys never mix with another's.
+    // Return nullptr when the compositor refused to create the device.
+    WaylandVirtualPointer* pointer();
+    WaylandVirtualKeyboard* keyboard();
+
+    // Serialized modifier state as last sent to the virtual keyboard
+    uint32_t modifier_state_depressed = 0;
+    uint32_t modifier_state_latched = 0;
+    uint32_t modifier_state_locked = 0;
+    uint32_t modifier_state_group = 0;
+
+    // Run a key (evdev keycode) through the session's xkb_state on the shared
+    // keymap, so every modifier the layout defines (AltGr, ISO level 3/5,
+    // locks, latches) is tracked. Returns true when the serialized state
+    // changed and a modifiers request is due.
+    bool update_modifier_state(uint32_t keycode, bool is_press);
+    // Drop depressed and latched modifiers of keys no longer in pressed_keys,
+    // keeping locks and the group; returns true when that changed anything
+    bool release_modifiers();
+
+    // Keys and buttons this session currently holds down, released on close
+    std::set<uint32_t> pressed_keys;
+    std::set<uint32_t> pressed_buttons;
+    void set_key_state(uint32_t keycode, bool pressed);
+    void set_button_state(uint32_t button, bool pressed);
+
+    // Requests queued since the last EIS frame, sent together by Portal::commit_eis_frame()
+    bool pointer_frame_pending = false;
+    bool keyboard_flush_pending = false;
+    // Motion and scroll accumulated until the next barrier or drained queue;
+    // D-Bus scroll goes through it as well so it shares the fractional carry
+    MotionCoalescer eis_motion;
+    // Wayland time (ms) of the latest input from the client, on our clock,
+    // and of the latest input merged into eis_motion
+    uint32_t event_time = 0;
+    uint32_t eis_motion_time = 0;
+    // Maps the client's EIS frame timestamps onto our clock
+    ClientClock client_clock;
+    // Input waiting for a stalled compositor, sent by Portal::drain_outgoing();
+    // while it holds anything, new input queues up behind it
+    OutgoingQueue outgoing;
+    // Reading from the EIS client (or the libei receiver) stopped because the queue is full
+    bool eis_paused = false;
+    // The client has ended a NotifyPointerAxis sequence with "finish", so its
+    // smooth scroll is sent as finger scrolling rather than continuous
+    bool dbus_scroll_finishes = false;
+    // Motion resampling: eis_motion waits for the next FrameClock tick
+    bool motion_deferred = false;
+
+    // Per-session latency histograms (owned by the LatencyTracker) and counters
+    LatencySet* latency = nullptr;
+    uint64_t events_received = 0;
+
+    // Drop the EIS client; the session object goes with the Session
+    void disconnect_eis();
+    void drop_eis_devices();
+
+private:
+    WaylandConnection* wayland;
+    std::unique_ptr<WaylandVirtualPointer> virtual_pointer;
+    std::unique_ptr<WaylandVirtualKeyboard> virtual_keyboard;
+    bool pointer_failed = false;
+    bool keyboard_failed = false;
+
+    struct xkb_state* xkb_state = nullptr;
+    uint64_t xkb_state_generation = 0;
+    bool ensure_xkb_state();
+    bool serialize_modifiers();
+};
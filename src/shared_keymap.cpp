@@ -0,0 +1,116 @@
+#include "shared_keymap.h"
+#include "logger.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SharedKeymap::SharedKeymap() {
+}
+
+SharedKeymap::~SharedKeymap() {
+    cleanup();
+}
+
+bool SharedKeymap::init() {
+    ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!ctx) {
+        LOG_ERROR("Failed to create XKB context");
+        return false;
+    }
+
+    struct xkb_keymap* keymap = xkb_keymap_new_from_names(ctx, nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!keymap) {
+        LOG_ERROR("Failed to compile default XKB keymap");
+        return false;
+    }
+    return publish(keymap);
+}
+
+void SharedKeymap::cleanup() {
+    if (memfd >= 0) {
+        close(memfd);
+        memfd = -1;
+    }
+    if (compiled) {
+        xkb_keymap_unref(compiled);
+        compiled = nullptr;
+    }
+    if (ctx) {
+        xkb_context_unref(ctx);
+        ctx = nullptr;
+    }
+    text.clear();
+}
+
+bool SharedKeymap::update(const char* data, size_t size) {
+    if (!ctx) return false;
+
+    // The size counts the terminating NUL; compile only what precedes it
+    size_t length = strnlen(data, size);
+    // Compositors echo back the keymap our virtual keyboards uploaded byte
+    // for byte; that must not cost a compile
+    if (compiled && text.compare(0, std::string::npos, data, length) == 0) {
+        return false;
+    }
+
+    struct xkb_keymap* keymap = xkb_keymap_new_from_buffer(ctx, data, length,
+                                                           XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                           XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!keymap) {
+        LOG_WARN("🗝️ Ignoring keymap from compositor that failed to compile");
+        return false;
+    }
+    return publish(keymap);
+}
+
+bool SharedKeymap::publish(struct xkb_keymap* keymap) {
+    // Compare the normalized text too, so a different spelling of the
+    // current keymap is still a no-op
+    char* serialized = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (!serialized) {
+        LOG_ERROR("Failed to serialize XKB keymap");
+        xkb_keymap_unref(keymap);
+        return false;
+    }
+    std::string next(serialized);
+    free(serialized);
+    if (compiled && next == text) {
+        xkb_keymap_unref(keymap);
+        return false;
+    }
+
+    int fd = memfd_create("keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create keymap memfd");
+        xkb_keymap_unref(keymap);
+        return false;
+    }
+    // Written with the terminating NUL, as wl_keyboard.keymap consumers expect
+    size_t size = next.size() + 1;
+    if (write(fd, next.c_str(), size) != static_cast<ssize_t>(size) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        LOG_ERROR("Failed to fill keymap memfd");
+        close(fd);
+        xkb_keymap_unref(keymap);
+        return false;
+    }
+
+    if (memfd >= 0) {
+        close(memfd);
+    }
+    if (compiled) {
+        xkb_keymap_unref(compiled);
+    }
+    memfd = fd;
+    compiled = keymap;
+    text = std::move(next);
+    current_generation++;
+    LOG_INFO("🗝️ Keymap published (" << size << " bytes, generation " << current_generation << ")");
+
+    if (change_listener) {
+        change_listener();
+    }
+    return true;
+}
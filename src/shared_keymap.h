@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <xkbcommon/xkbcommon.h>
+
+// The compositor's active keymap, compiled once and published as a single
+// sealed memfd. Every virtual keyboard and every EIS client receives that same
+// fd, so a layout change costs one compile and one copy however many clients
+// are connected.
+class SharedKeymap {
+public:
+    using ChangeListener = std::function<void()>;
+
+    SharedKeymap();
+    ~SharedKeymap();
+
+    SharedKeymap(const SharedKeymap&) = delete;
+    SharedKeymap& operator=(const SharedKeymap&) = delete;
+
+    // Start from the default layout (XKB_DEFAULT_* environment, else US) until
+    // the compositor tells us its own
+    bool init();
+    void cleanup();
+
+    // Keymap text as sent in wl_keyboard.keymap. Returns true if it differs
+    // from the current one and was published; text identical to the current
+    // keymap is recognized without compiling it.
+    bool update(const char* text, size_t size);
+
+    // Called after a new keymap was published
+    void set_change_listener(ChangeListener listener) { change_listener = std::move(listener); }
+
+    // Sealed against writes and resizing; receivers can map it but never modify it
+    int fd() const { return memfd; }
+    // Size including the terminating NUL, as the keymap requests expect
+    uint32_t size() const { return static_cast<uint32_t>(text.size() + 1); }
+    struct xkb_keymap* keymap() const { return compiled; }
+    // Bumped on every change, so consumers can tell whether they are current
+    uint64_t generation() const { return current_generation; }
+
+private:
+    struct xkb_context* ctx = nullptr;
+    struct xkb_keymap* compiled = nullptr;
+    std::string text;
+    int memfd = -1;
+    uint64_t current_generation = 0;
+    ChangeListener change_listener;
+
+    // Takes ownership of keymap; false if it failed or matches the current one
+    bool publish(struct xkb_keymap* keymap);
+};
@@ -0,0 +1,47 @@
+#include "thread_scheduling.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
+
+void apply_thread_scheduling(const ThreadScheduling& scheduling) {
+    if (scheduling.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(scheduling.cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+            LOG_WARN("Failed to pin input thread to CPU " << scheduling.cpu << ": " << strerror(errno));
+        }
+    }
+}
+
+std::string describe_thread_scheduling() {
+    int policy = sched_getscheduler(0);
+    struct sched_param param = {};
+    sched_getparam(0, &param);
+
+    std::string description;
+    switch (policy & ~SCHED_RESET_ON_FORK) {
+        case SCHED_FIFO: description = "SCHED_FIFO"; break;
+        case SCHED_RR: description = "SCHED_RR"; break;
+        case SCHED_OTHER: description = "SCHED_OTHER"; break;
+        case SCHED_BATCH: description = "SCHED_BATCH"; break;
+        case SCHED_IDLE: description = "SCHED_IDLE"; break;
+        default: description = "policy " + std::to_string(policy); break;
+    }
+    if (param.sched_priority > 0) {
+        description += " priority " + std::to_string(param.sched_priority);
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) == 1) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                description += " on CPU " + std::to_string(cpu);
+                break;
+            }
+        }
+    }
+    return description;
+}
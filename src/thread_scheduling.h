@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+// Opt-in CPU placement for the thread that forwards input, so a busy
+// workstation (a build on every core) doesn't keep moving it around. Off by
+// default. Its policy stays normal: input is forwarded on the event loop
+// thread that also serves D-Bus, and the control plane must not run at
+// real-time priority.
+struct ThreadScheduling {
+    // Pin the thread to this CPU; -1 leaves affinity alone
+    int cpu = -1;
+};
+
+// Apply to the calling thread. Failures are logged and leave the thread as it
+// was; check describe_thread_scheduling() for what it actually got.
+void apply_thread_scheduling(const ThreadScheduling& scheduling);
+
+// The calling thread's policy, priority and CPUs, e.g. "SCHED_OTHER on CPU 2"
+std::string describe_thread_scheduling();
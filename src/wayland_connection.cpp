@@ -0,0 +1,281 @@
+#include "wayland_connection.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "latency_stats.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const struct wl_registry_listener registry_listener = {
+    .global = WaylandConnection::registry_global,
+    .global_remove = WaylandConnection::registry_global_remove,
+};
+
+static const struct wl_seat_listener seat_listener = {
+    .capabilities = WaylandConnection::seat_capabilities,
+    .name = [](void*, struct wl_seat*, const char*) {},
+};
+
+// Only the keymap matters; we never have focus, so the rest doesn't arrive
+static const struct wl_keyboard_listener keyboard_listener = {
+    .keymap = WaylandConnection::keyboard_keymap,
+    .enter = [](void*, struct wl_keyboard*, uint32_t, struct wl_surface*, struct wl_array*) {},
+    .leave = [](void*, struct wl_keyboard*, uint32_t, struct wl_surface*) {},
+    .key = [](void*, struct wl_keyboard*, uint32_t, uint32_t, uint32_t, uint32_t) {},
+    .modifiers = [](void*, struct wl_keyboard*, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) {},
+    .repeat_info = [](void*, struct wl_keyboard*, int32_t, int32_t) {},
+};
+
+WaylandConnection::WaylandConnection()
+    : display(nullptr), event_loop(nullptr), registry(nullptr), seat(nullptr),
+      keyboard_manager(nullptr), pointer_manager(nullptr) {
+}
+
+WaylandConnection::~WaylandConnection() {
+    cleanup();
+}
+
+bool WaylandConnection::init() {
+    display = wl_display_connect(nullptr);
+    if (!display) {
+        LOG_ERROR("Failed to connect to Wayland display");
+        return false;
+    }
+
+    // Fallback until the compositor sends its own keymap
+    if (!keymap.init()) {
+        cleanup();
+        return false;
+    }
+
+    registry = wl_display_get_registry(display);
+    if (!registry) {
+        LOG_ERROR("Failed to get Wayland registry");
+        cleanup();
+        return false;
+    }
+
+    // Three roundtrips: the first announces the globals (seat, managers,
+    // outputs), the second the output geometry and seat capabilities of the
+    // objects bound there, the third the keymap of the keyboard requested
+    // in answer to the capabilities
+    wl_registry_add_listener(registry, &registry_listener, this);
+    for (int i = 0; i < 3; i++) {
+        if (wl_display_roundtrip(display) < 0) {
+            LOG_ERROR("Wayland connection failed during setup: " << strerror(wl_display_get_error(display)));
+            cleanup();
+            return false;
+        }
+    }
+
+    if (!seat) {
+        LOG_ERROR("Compositor did not advertise a wl_seat");
+        cleanup();
+        return false;
+    }
+
+    LOG_INFO("Wayland connection initialized successfully");
+    return true;
+}
+
+void WaylandConnection::cleanup() {
+    if (event_loop && display) {
+        event_loop->remove_fd(wl_display_get_fd(display));
+    }
+    event_loop = nullptr;
+    
+    outputs.cleanup();
+    if (keyboard) {
+        wl_keyboard_destroy(keyboard);
+        keyboard = nullptr;
+    }
+    if (keyboard_manager) {
+        zwp_virtual_keyboard_manager_v1_destroy(keyboard_manager);
+        keyboard_manager = nullptr;
+    }
+    if (pointer_manager) {
+        zwlr_virtual_pointer_manager_v1_destroy(pointer_manager);
+        pointer_manager = nullptr;
+    }
+    if (seat) {
+        wl_seat_destroy(seat);
+        seat = nullptr;
+    }
+    if (registry) {
+        wl_registry_destroy(registry);
+        registry = nullptr;
+    }
+    if (display) {
+        wl_display_disconnect(display);
+        display = nullptr;
+    }
+    keymap.cleanup();
+}
+
+bool WaylandConnection::attach(EventLoop& loop) {
+    if (!display) return false;
+    
+    EventLoop* owner = &loop;
+    if (!loop.add_fd(wl_display_get_fd(display), EPOLLIN, [this, owner](uint32_t events) {
+            if ((events & (EPOLLERR | EPOLLHUP)) ||
+                ((events & EPOLLIN) && !read_events())) {
+                LOG_ERROR("Lost connection to Wayland display");
+                owner->stop();
+                return;
+            }
+            if (events & EPOLLOUT) {
+                resume();
+            }
+        })) {
+        return false;
+    }
+    event_loop = &loop;
+    return true;
+}
+
+bool WaylandConnection::read_events() {
+    // Not wl_display_dispatch(): it flushes first, and with the socket full
+    // that waits in poll() until the compositor reads again, wedging the
+    // event loop for as long as the stall lasts
+    while (wl_display_prepare_read(display) != 0) {
+        if (wl_display_dispatch_pending(display) < 0) return false;
+    }
+    // Cancels the read intent itself when it fails
+    if (wl_display_read_events(display) < 0) return false;
+    if (wl_display_dispatch_pending(display) < 0) return false;
+    
+    // Requests the handlers made (e.g. binding a new output) go out now,
+    // unless the stall is still on; then they wait for resume()
+    if (!write_blocked) {
+        flush();
+    }
+    return true;
+}
+
+bool WaylandConnection::flush() {
+    if (!display) return false;
+    // The EPOLLOUT handler finishes the pending flush
+    if (write_blocked) return false;
+    
+    if (wl_display_flush(display) < 0) {
+        if (errno == EAGAIN) {
+            block();
+        }
+        // Anything else is a dead connection, which the next dispatch reports
+        return false;
+    }
+    flushes++;
+    if (latency) {
+        latency->flushed();
+    }
+    return true;
+}
+
+const char* to_string(WaylandRequest request) {
+    switch (request) {
+        case WaylandRequest::PointerMotion: return "pointer_motion";
+        case WaylandRequest::PointerMotionAbsolute: return "pointer_motion_absolute";
+        case WaylandRequest::PointerButton: return "pointer_button";
+        case WaylandRequest::PointerAxis: return "pointer_axis";
+        case WaylandRequest::PointerAxisSource: return "pointer_axis_source";
+        case WaylandRequest::PointerAxisStop: return "pointer_axis_stop";
+        case WaylandRequest::PointerFrame: return "pointer_frame";
+        case WaylandRequest::KeyboardKey: return "keyboard_key";
+        case WaylandRequest::KeyboardModifiers: return "keyboard_modifiers";
+        case WaylandRequest::Count: break;
+    }
+    return "unknown";
+}
+
+void WaylandConnection::block() {
+    write_blocked = true;
+    stalls++;
+    LOG_DEBUG("⏳ Compositor is not reading; holding input until it catches up");
+    if (event_loop) {
+        event_loop->modify_fd(wl_display_get_fd(display), EPOLLIN | EPOLLOUT);
+    }
+}
+
+void WaylandConnection::resume() {
+    if (!write_blocked) return;
+    if (wl_display_flush(display) < 0 && errno == EAGAIN) return;
+    
+    write_blocked = false;
+    flushes++;
+    if (event_loop) {
+        event_loop->modify_fd(wl_display_get_fd(display), EPOLLIN);
+    }
+    if (latency) {
+        latency->flushed();
+    }
+    LOG_DEBUG("⏳ Compositor caught up");
+    if (writable_listener) {
+        writable_listener();
+    }
+}
+
+void WaylandConnection::registry_global(void* data, struct wl_registry* registry,
+                                        uint32_t name, const char* interface, uint32_t version) {
+    WaylandConnection* self = static_cast<WaylandConnection*>(data);
+    
+    if (strcmp(interface, zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
+        self->keyboard_manager = static_cast<struct zwp_virtual_keyboard_manager_v1*>(
+            wl_registry_bind(registry, name, &zwp_virtual_keyboard_manager_v1_interface, 1));
+    } else if (strcmp(interface, zwlr_virtual_pointer_manager_v1_interface.name) == 0) {
+        self->pointer_manager = static_cast<struct zwlr_virtual_pointer_manager_v1*>(
+            wl_registry_bind(registry, name, &zwlr_virtual_pointer_manager_v1_interface, 
+                           std::min(version, 2u)));
+    } else if (strcmp(interface, wl_seat_interface.name) == 0 && !self->seat) {
+        self->seat = static_cast<struct wl_seat*>(
+            wl_registry_bind(registry, name, &wl_seat_interface, 1));
+        wl_seat_add_listener(self->seat, &seat_listener, self);
+    } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        uint32_t bound = std::min(version, 4u);
+        self->outputs.add_output(static_cast<struct wl_output*>(
+            wl_registry_bind(registry, name, &wl_output_interface, bound)), name, bound);
+    } else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
+        self->outputs.set_xdg_output_manager(static_cast<struct zxdg_output_manager_v1*>(
+            wl_registry_bind(registry, name, &zxdg_output_manager_v1_interface, std::min(version, 3u))));
+    }
+}
+
+void WaylandConnection::registry_global_remove(void* data, struct wl_registry* registry, uint32_t name) {
+    WaylandConnection* self = static_cast<WaylandConnection*>(data);
+    // Unplugged monitors; the other globals we bind are not expected to go away
+    self->outputs.remove_output(name);
+}
+
+void WaylandConnection::seat_capabilities(void* data, struct wl_seat* seat, uint32_t capabilities) {
+    WaylandConnection* self = static_cast<WaylandConnection*>(data);
+    
+    // A wl_keyboard of our own, only to be told the seat's keymap
+    if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && !self->keyboard) {
+        self->keyboard = wl_seat_get_keyboard(seat);
+        wl_keyboard_add_listener(self->keyboard, &keyboard_listener, self);
+    } else if (!(capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && self->keyboard) {
+        wl_keyboard_destroy(self->keyboard);
+        self->keyboard = nullptr;
+    }
+}
+
+void WaylandConnection::keyboard_keymap(void* data, struct wl_keyboard* keyboard,
+                                        uint32_t format, int32_t fd, uint32_t size) {
+    WaylandConnection* self = static_cast<WaylandConnection*>(data);
+    
+    if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1 || size == 0) {
+        close(fd);
+        return;
+    }
+    void* text = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        LOG_WARN("🗝️ Failed to map compositor keymap");
+        return;
+    }
+    self->keymap.update(static_cast<const char*>(text), size);
+    munmap(text, size);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+extern "C" {
+#include <wayland-client.h>
+#include "virtual-keyboard-unstable-v1-client-protocol.h"
+#include "wlr-virtual-pointer-unstable-v1-client-protocol.h"
+}
+
+#include <cstdint>
+#include <functional>
+#include "output_layout.h"
+#include "shared_keymap.h"
+
+class EventLoop;
+class InputCapture;
+class LatencyTracker;
+
+// Input requests sent on the virtual devices, for metrics
+enum class WaylandRequest {
+    PointerMotion,
+    PointerMotionAbsolute,
+    PointerButton,
+    PointerAxis,
+    PointerAxisSource,
+    PointerAxisStop,
+    PointerFrame,
+    KeyboardKey,
+    KeyboardModifiers,
+    Count
+};
+
+const char* to_string(WaylandRequest request);
+
+// One Wayland connection shared by the virtual keyboard and pointer, so their
+// requests travel through a single ordered stream to the compositor
+class WaylandConnection {
+public:
+    WaylandConnection();
+    ~WaylandConnection();
+    
+    bool init();
+    void cleanup();
+    // Read and dispatch compositor events when the display fd is readable
+    bool attach(EventLoop& loop);
+    
+    // Push all queued requests to the compositor. Returns false if it isn't
+    // reading them: the socket is full, and what is left goes out once it
+    // drains. Nothing more should be written until then.
+    bool flush();
+    // The last flush could not write everything
+    bool blocked() const { return write_blocked; }
+    // Called once a blocked connection has drained
+    void set_writable_listener(std::function<void()> listener) { writable_listener = std::move(listener); }
+    // How often flushing found the socket full
+    uint64_t stall_count() const { return stalls; }
+    // Flushes that went through
+    uint64_t flush_count() const { return flushes; }
+    // Called by the virtual devices for every request they send
+    void count_request(WaylandRequest request) { requests[static_cast<size_t>(request)]++; }
+    uint64_t request_count(WaylandRequest request) const { return requests[static_cast<size_t>(request)]; }
+    
+    // Told every time a flush returns so it can close out per-event latencies
+    void set_latency_tracker(LatencyTracker* tracker) { latency = tracker; }
+    // Where the virtual devices record the requests they send, if anywhere
+    void set_capture(InputCapture* recorder) { capture = recorder; }
+    InputCapture* get_capture() const { return capture; }
+    
+    struct wl_display* get_display() const { return display; }
+    struct wl_seat* get_seat() const { return seat; }
+    struct zwp_virtual_keyboard_manager_v1* get_keyboard_manager() const { return keyboard_manager; }
+    struct zwlr_virtual_pointer_manager_v1* get_pointer_manager() const { return pointer_manager; }
+    // Monitor geometry, kept current as outputs come, go and change mode
+    OutputLayout& get_outputs() { return outputs; }
+    // The seat's active keymap, followed through wl_keyboard.keymap
+    SharedKeymap& get_keymap() { return keymap; }
+
+    // Registry callback functions (must be public)
+    static void registry_global(void* data, struct wl_registry* registry,
+                              uint32_t name, const char* interface, uint32_t version);
+    static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+    static void seat_capabilities(void* data, struct wl_seat* seat, uint32_t capabilities);
+    static void keyboard_keymap(void* data, struct wl_keyboard* keyboard, uint32_t format, int32_t fd, uint32_t size);
+    
+private:
+    struct wl_display* display;
+    EventLoop* event_loop;
+    struct wl_registry* registry;
+    struct wl_seat* seat;
+    struct wl_keyboard* keyboard = nullptr;
+    struct zwp_virtual_keyboard_manager_v1* keyboard_manager;
+    struct zwlr_virtual_pointer_manager_v1* pointer_manager;
+    OutputLayout outputs;
+    SharedKeymap keymap;
+    LatencyTracker* latency = nullptr;
+    InputCapture* capture = nullptr;
+
+    bool write_blocked = false;
+    uint64_t stalls = 0;
+    uint64_t flushes = 0;
+    uint64_t requests[static_cast<size_t>(WaylandRequest::Count)] = {};
+    std::function<void()> writable_listener;
+    // Read and dispatch compositor events without ever flushing while blocked
+    bool read_events();
+    // Poll for writability until the blocked flush completes
+    void block();
+    void resume();
+};
@@ -5,30 +5,36 @@ extern "C" {
 #include "virtual-keyboard-unstable-v1-client-protocol.h"
 }
 
+class WaylandConnection;
+class SharedKeymap;
+
 class WaylandVirtualKeyboard {
 public:
     WaylandVirtualKeyboard();
     ~WaylandVirtualKeyboard();
     
-    bool init();
+    bool init(WaylandConnection* conn);
     void cleanup();
     
     // Keyboard input methods
     void send_key(uint32_t time, uint32_t key, uint32_t state);
     void send_modifiers(uint32_t mods_depressed, uint32_t mods_latched, 
                        uint32_t mods_locked, uint32_t group);
-
-    // Registry callback functions (must be public)
-    static void registry_global(void* data, struct wl_registry* registry,
-                              uint32_t name, const char* interface, uint32_t version);
-    static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+    
+    // Push all queued requests to the compositor
+    void flush();
+    
+    // Session id the requests are recorded under in an input capture
+    void set_capture_session(uint32_t session) { capture_session = session; }
     
 private:
-    struct wl_display* display;
-    struct wl_registry* registry;
-    struct wl_seat* seat;
-    struct zwp_virtual_keyboard_manager_v1* keyboard_manager;
+    WaylandConnection* connection;
     struct zwp_virtual_keyboard_v1* virtual_keyboard;
+    uint32_t capture_session = 0;
+    // SharedKeymap generation last uploaded
+    uint64_t keymap_generation = 0;
     
     bool setup_keymap();
-}; 
\ No newline at end of file
+    // Upload the shared keymap again if the layout changed since
+    void sync_keymap();
+};
@@ -1,54 +1,37 @@
 #include "wayland_virtual_pointer.h"
+#include "wayland_connection.h"
+#include "input_capture.h"
+#include "logger.h"
 #include <iostream>
 #include <cstring>
 
-static const struct wl_registry_listener registry_listener = {
-    .global = WaylandVirtualPointer::registry_global,
-    .global_remove = WaylandVirtualPointer::registry_global_remove,
-};
-
 WaylandVirtualPointer::WaylandVirtualPointer()
-    : display(nullptr), registry(nullptr), seat(nullptr), 
-      pointer_manager(nullptr), virtual_pointer(nullptr) {
+    : connection(nullptr), virtual_pointer(nullptr) {
 }
 
 WaylandVirtualPointer::~WaylandVirtualPointer() {
     cleanup();
 }
 
-bool WaylandVirtualPointer::init() {
-    display = wl_display_connect(nullptr);
-    if (!display) {
-        std::cerr << "Failed to connect to Wayland display" << std::endl;
-        return false;
-    }
-
-    registry = wl_display_get_registry(display);
-    if (!registry) {
-        std::cerr << "Failed to get Wayland registry" << std::endl;
-        cleanup();
-        return false;
-    }
-
-    wl_registry_add_listener(registry, &registry_listener, this);
-    wl_display_roundtrip(display);
-
-    if (!pointer_manager) {
-        std::cerr << "Compositor does not support wlr-virtual-pointer protocol" << std::endl;
-        cleanup();
+bool WaylandVirtualPointer::init(WaylandConnection* conn) {
+    connection = conn;
+    
+    if (!connection || !connection->get_pointer_manager()) {
+        LOG_ERROR("Compositor does not support wlr-virtual-pointer protocol");
         return false;
     }
 
     // Create virtual pointer
-    virtual_pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer(pointer_manager, seat);
+    virtual_pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer(
+        connection->get_pointer_manager(), connection->get_seat());
     if (!virtual_pointer) {
-        std::cerr << "Failed to create virtual pointer" << std::endl;
+        LOG_ERROR("Failed to create virtual pointer");
         cleanup();
         return false;
     }
 
-    wl_display_roundtrip(display);
-    std::cout << "Wayland Virtual Pointer initialized successfully" << std::endl;
+    connection->flush();
+    LOG_INFO("Wayland Virtual Pointer initialized successfully");
     return true;
 }
 
@@ -57,40 +40,6 @@ void WaylandVirtualPointer::cleanup() {
         zwlr_virtual_pointer_v1_destroy(virtual_pointer);
         virtual_pointer = nullptr;
     }
-    if (pointer_manager) {
-        zwlr_virtual_pointer_manager_v1_destroy(pointer_manager);
-        pointer_manager = nullptr;
-    }
-    if (seat) {
-        wl_seat_destroy(seat);
-        seat = nullptr;
-    }
-    if (registry) {
-        wl_registry_destroy(registry);
-        registry = nullptr;
-    }
-    if (display) {
-        wl_display_disconnect(display);
-        display = nullptr;
-    }
-}
-
-void WaylandVirtualPointer::registry_global(void* data, struct wl_registry* registry,
-                                           uint32_t name, const char* interface, uint32_t version) {
-    WaylandVirtualPointer* self = static_cast<WaylandVirtualPointer*>(data);
-    
-    if (strcmp(interface, zwlr_virtual_pointer_manager_v1_interface.name) == 0) {
-        self->pointer_manager = static_cast<struct zwlr_virtual_pointer_manager_v1*>(
-            wl_registry_bind(registry, name, &zwlr_virtual_pointer_manager_v1_interface, 
-                           std::min(version, 2u)));
-    } else if (strcmp(interface, wl_seat_interface.name) == 0) {
-        self->seat = static_cast<struct wl_seat*>(
-            wl_registry_bind(registry, name, &wl_seat_interface, 1));
-    }
-}
-
-void WaylandVirtualPointer::registry_global_remove(void* data, struct wl_registry* registry, uint32_t name) {
-    // Handle global removal if needed
 }
 
 void WaylandVirtualPointer::send_motion(uint32_t time, double dx, double dy) {
@@ -98,6 +47,10 @@ void WaylandVirtualPointer::send_motion(uint32_t time, double dx, double dy) {
         zwlr_virtual_pointer_v1_motion(virtual_pointer, time, 
                                      wl_fixed_from_double(dx), 
                                      wl_fixed_from_double(dy));
+        connection->count_request(WaylandRequest::PointerMotion);
+        if (InputCapture* capture = connection->get_capture()) {
+            capture->record(CaptureSource::Wayland, CaptureType::PointerMotion, capture_session, dx, dy);
+        }
     }
 }
 
@@ -105,47 +58,83 @@ void WaylandVirtualPointer::send_motion_absolute(uint32_t time, uint32_t x, uint
                                                uint32_t x_extent, uint32_t y_extent) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_motion_absolute(virtual_pointer, time, x, y, x_extent, y_extent);
+        connection->count_request(WaylandRequest::PointerMotionAbsolute);
+        if (InputCapture* capture = connection->get_capture()) {
+            capture->record(CaptureSource::Wayland, CaptureType::PointerMotionAbsolute, capture_session,
+                            x, y, x_extent, y_extent);
+        }
     }
 }
 
 void WaylandVirtualPointer::send_button(uint32_t time, uint32_t button, uint32_t state) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_button(virtual_pointer, time, button, state);
+        connection->count_request(WaylandRequest::PointerButton);
+        if (InputCapture* capture = connection->get_capture()) {
+            capture->record(CaptureSource::Wayland, CaptureType::PointerButton, capture_session, button, state);
+        }
     }
 }
 
-void WaylandVirtualPointer::send_axis(uint32_t time, uint32_t axis, double dx, double dy) {
+void WaylandVirtualPointer::send_axis(uint32_t time, uint32_t axis, double value) {
     if (virtual_pointer) {
-        zwlr_virtual_pointer_v1_axis(virtual_pointer, time, axis, wl_fixed_from_double(dx));
+        zwlr_virtual_pointer_v1_axis(virtual_pointer, time, axis, wl_fixed_from_double(value));
+        connection->count_request(WaylandRequest::PointerAxis);
+        capture_axis(axis, value, 0);
     }
 }
 
 void WaylandVirtualPointer::send_axis_source(uint32_t axis_source) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_axis_source(virtual_pointer, axis_source);
+        connection->count_request(WaylandRequest::PointerAxisSource);
+        if (InputCapture* capture = connection->get_capture()) {
+            capture->record(CaptureSource::Wayland, CaptureType::PointerAxisSource, capture_session, axis_source);
+        }
     }
 }
 
-void WaylandVirtualPointer::send_axis_discrete(uint32_t time, int32_t dx, int32_t dy) {
-    std::cout << "send_axis_discrete: dx=" << dx << " dy=" << dy << std::endl;
+void WaylandVirtualPointer::send_axis_discrete(uint32_t time, uint32_t axis, double value, int32_t steps) {
+    LOG_TRACE("send_axis_discrete: axis=" << axis << " value=" << value << " steps=" << steps);
     if (virtual_pointer) {
-        if(dy < 0) {
-            zwlr_virtual_pointer_v1_axis_discrete(virtual_pointer, time, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_int(-15), -1);
-        } else if(dy > 0) {
-            zwlr_virtual_pointer_v1_axis_discrete(virtual_pointer, time, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_int(15), 1);
-        }
+        zwlr_virtual_pointer_v1_axis_discrete(virtual_pointer, time, axis, wl_fixed_from_double(value), steps);
+        connection->count_request(WaylandRequest::PointerAxis);
+        capture_axis(axis, value, steps);
     }
 }
 
 void WaylandVirtualPointer::send_axis_stop(uint32_t time, uint32_t axis) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_axis_stop(virtual_pointer, time, axis);
+        connection->count_request(WaylandRequest::PointerAxisStop);
+        if (InputCapture* capture = connection->get_capture()) {
+            capture->record(CaptureSource::Wayland, CaptureType::PointerAxisStop, capture_session, axis);
+        }
     }
 }
 
 void WaylandVirtualPointer::send_frame() {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_frame(virtual_pointer);
-        wl_display_flush(display);
+        connection->count_request(WaylandRequest::PointerFrame);
+        if (InputCapture* capture = connection->get_capture()) {
+            capture->record(CaptureSource::Wayland, CaptureType::PointerFrame, capture_session);
+        }
+    }
+}
+
+void WaylandVirtualPointer::capture_axis(uint32_t axis, double value, int32_t steps) {
+    InputCapture* capture = connection->get_capture();
+    if (!capture) return;
+    if (CaptureRecord* record = capture->append(CaptureSource::Wayland, CaptureType::PointerAxis, capture_session)) {
+        record->u[0] = axis;
+        record->i[1] = steps;
+        record->d[1] = value;
+    }
+}
+
+void WaylandVirtualPointer::flush() {
+    if (connection) {
+        connection->flush();
     }
 } 
\ No newline at end of file
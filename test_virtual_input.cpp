@@ -1,3 +1,4 @@
+#include "src/wayland_connection.h"
 #include "src/wayland_virtual_pointer.h"
 #include "src/wayland_virtual_keyboard.h"
 #include <iostream>
@@ -12,8 +13,14 @@ extern "C" {
 int main() {
     std::cout << "Testing Wayland Virtual Input..." << std::endl;
     
+    WaylandConnection connection;
+    if (!connection.init()) {
+        std::cerr << "Failed to connect to Wayland compositor" << std::endl;
+        return 1;
+    }
+    
     WaylandVirtualPointer pointer;
-    if (!pointer.init()) {
+    if (!pointer.init(&connection)) {
         std::cerr << "Failed to initialize virtual pointer" << std::endl;
         return 1;
     }
@@ -33,6 +40,7 @@ int main() {
         
         pointer.send_motion(time + i, dx, dy);
         pointer.send_frame();
+        pointer.flush();
         
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
@@ -43,13 +51,16 @@ int main() {
     // Test a left click
     pointer.send_button(time + 1000, BTN_LEFT, 1); // Press
     pointer.send_frame();
+    pointer.flush();
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     
     pointer.send_button(time + 1100, BTN_LEFT, 0); // Release
     pointer.send_frame();
+    pointer.flush();
     
     std::cout << "✓ Mouse click test completed" << std::endl;
     
     pointer.cleanup();
+    connection.cleanup();
     return 0;
 } 
\ No newline at end of file
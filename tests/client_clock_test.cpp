@@ -0,0 +1,63 @@
+#include "test.h"
+#include "client_clock.h"
+
+TEST(client_clock, keeps_the_client_spacing) {
+    ClientClock clock;
+    // Client stamps are 1 ms apart; delivery jitters between 2 and 5 ms
+    uint64_t base_ns = 1000000000ull;
+    uint64_t first = clock.map(100000, base_ns + 2000000);
+    uint64_t second = clock.map(101000, base_ns + 1000000 + 5000000);
+    uint64_t third = clock.map(102000, base_ns + 2000000 + 3000000);
+    // Only 1/1024 of the extra delay leaks through as drift correction
+    CHECK_NEAR(static_cast<double>(second - first), 1000000.0, 5000.0);
+    CHECK_NEAR(static_cast<double>(third - second), 1000000.0, 5000.0);
+}
+
+TEST(client_clock, never_later_than_received) {
+    ClientClock clock;
+    uint64_t received = 5000000000ull;
+    clock.map(1000, received);
+    // A stamp far ahead of the first one counts as the fastest delivery yet
+    CHECK_EQ(clock.map(1000000, received + 1000), received + 1000);
+}
+
+TEST(client_clock, never_goes_backwards) {
+    ClientClock clock;
+    uint64_t a = clock.map(2000, 10000000);
+    // A later event stamped earlier still maps after the one before it
+    uint64_t b = clock.map(1000, 10500000);
+    CHECK(b >= a);
+    CHECK(b <= 10500000ull);
+}
+
+TEST(client_clock, faster_delivery_moves_the_offset) {
+    ClientClock clock;
+    clock.map(1000, 20000000);          // offset 19 ms
+    uint64_t mapped = clock.map(2000, 20000000 + 500000);  // delivered in 18.5 ms: new offset
+    CHECK_EQ(mapped, 20000000ull + 500000ull);
+}
+
+TEST(client_clock, follows_drift_slowly) {
+    ClientClock clock;
+    uint64_t offset = 10000000;
+    clock.map(1000, 1000000 + offset);
+    // Every later event arrives 1 ms later than the fastest one did
+    uint64_t mapped = 0;
+    uint64_t received = 0;
+    for (uint64_t i = 1; i <= 5000; i++) {
+        received = (1000 + i * 1000) * 1000 + offset + 1000000;
+        mapped = clock.map(1000 + i * 1000, received);
+    }
+    // After thousands of events the offset has caught up most of the way
+    CHECK(received - mapped < 100000);
+}
+
+TEST(client_clock, zero_stamp_maps_to_receive_time) {
+    ClientClock clock;
+    CHECK_EQ(clock.map(0, 123456789), 123456789ull);
+}
+
+TEST(client_clock, wayland_time_is_milliseconds) {
+    CHECK_EQ(wayland_time(1999999), 1u);
+    CHECK_EQ(wayland_time(2000000), 2u);
+}
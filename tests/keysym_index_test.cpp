@@ -0,0 +1,110 @@
+#include "test.h"
+#include "keysym_index.h"
+#include <linux/input-event-codes.h>
+
+// Just enough of a keymap: a two-level letter key, Shift, and "1" reachable
+// both shifted on the digit row and unshifted on the keypad
+static const char* KEYMAP = R"(xkb_keymap {
+    xkb_keycodes "test" {
+        minimum = 8;
+        maximum = 255;
+        <AE01> = 10;
+        <AC01> = 38;
+        <LFSH> = 50;
+        <KP1>  = 87;
+    };
+    xkb_types "test" {
+        type "ONE_LEVEL" {
+            modifiers = none;
+            level_name[Level1] = "Any";
+        };
+        type "TWO_LEVEL" {
+            modifiers = Shift;
+            map[Shift] = Level2;
+            level_name[Level1] = "Base";
+            level_name[Level2] = "Shift";
+        };
+    };
+    xkb_compatibility "test" {
+    };
+    xkb_symbols "test" {
+        key <AE01> { type = "TWO_LEVEL", [ exclam, 1 ] };
+        key <AC01> { type = "TWO_LEVEL", [ a, A ] };
+        key <LFSH> { type = "ONE_LEVEL", [ Shift_L ] };
+        key <KP1>  { type = "ONE_LEVEL", [ 1 ] };
+        modifier_map Shift { <LFSH> };
+    };
+};)";
+
+struct Keymap {
+    Keymap() {
+        // Nothing from the system's XKB data or the environment may leak in
+        context = xkb_context_new(static_cast<xkb_context_flags>(
+            XKB_CONTEXT_NO_DEFAULT_INCLUDES | XKB_CONTEXT_NO_ENVIRONMENT_NAMES));
+        if (context) {
+            keymap = xkb_keymap_new_from_string(context, KEYMAP, XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                XKB_KEYMAP_COMPILE_NO_FLAGS);
+        }
+    }
+    ~Keymap() {
+        xkb_keymap_unref(keymap);
+        xkb_context_unref(context);
+    }
+
+    struct xkb_context* context = nullptr;
+    struct xkb_keymap* keymap = nullptr;
+};
+
+TEST(keysym_index, finds_keys_and_their_modifiers) {
+    Keymap keymap;
+    REQUIRE(keymap.keymap);
+    xkb_mod_mask_t shift = 1u << xkb_keymap_mod_get_index(keymap.keymap, XKB_MOD_NAME_SHIFT);
+
+    KeysymIndex index;
+    index.rebuild(keymap.keymap);
+
+    const KeysymIndex::Entry* a = index.lookup(XKB_KEY_a);
+    REQUIRE(a);
+    CHECK_EQ(a->keycode, static_cast<uint32_t>(KEY_A));
+    CHECK_EQ(a->mods, 0u);
+
+    const KeysymIndex::Entry* upper = index.lookup(XKB_KEY_A);
+    REQUIRE(upper);
+    CHECK_EQ(upper->keycode, static_cast<uint32_t>(KEY_A));
+    CHECK_EQ(upper->mods, shift);
+
+    CHECK(index.lookup(XKB_KEY_z) == nullptr);
+}
+
+TEST(keysym_index, prefers_fewest_modifiers) {
+    Keymap keymap;
+    REQUIRE(keymap.keymap);
+
+    KeysymIndex index;
+    index.rebuild(keymap.keymap);
+
+    // The keypad "1" needs no Shift, unlike the one on the digit row
+    const KeysymIndex::Entry* one = index.lookup(XKB_KEY_1);
+    REQUIRE(one);
+    CHECK_EQ(one->keycode, static_cast<uint32_t>(KEY_KP1));
+    CHECK_EQ(one->mods, 0u);
+}
+
+TEST(keysym_index, rebuild_and_clear) {
+    Keymap keymap;
+    REQUIRE(keymap.keymap);
+
+    KeysymIndex index;
+    index.rebuild(keymap.keymap);
+    size_t size = index.size();
+    CHECK_EQ(size, 5u);
+    index.rebuild(keymap.keymap);
+    CHECK_EQ(index.size(), size);
+
+    index.clear();
+    CHECK_EQ(index.size(), 0u);
+    CHECK(index.lookup(XKB_KEY_a) == nullptr);
+
+    index.rebuild(nullptr);
+    CHECK_EQ(index.size(), 0u);
+}
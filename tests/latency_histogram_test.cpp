@@ -0,0 +1,66 @@
+#include "test.h"
+#include "latency_stats.h"
+
+TEST(latency_histogram, empty) {
+    LatencyHistogram histogram;
+    CHECK_EQ(histogram.count(), 0u);
+    CHECK_EQ(histogram.percentile(0.5), 0u);
+}
+
+TEST(latency_histogram, percentiles_within_bucket_precision) {
+    LatencyHistogram histogram;
+    // 1..10000 us
+    for (uint64_t us = 1; us <= 10000; us++) {
+        histogram.record(us * 1000);
+    }
+    CHECK_EQ(histogram.count(), 10000u);
+    CHECK_EQ(histogram.max(), 10000000u);
+    CHECK_EQ(histogram.sum(), 10000ull * 10001 / 2 * 1000);
+    // Reported values may be up to ~6% above the recorded ones, never below
+    double p50 = static_cast<double>(histogram.percentile(0.50));
+    double p99 = static_cast<double>(histogram.percentile(0.99));
+    CHECK(p50 >= 5000000.0 && p50 <= 5000000.0 * 1.07);
+    CHECK(p99 >= 9900000.0 && p99 <= 9900000.0 * 1.07);
+    CHECK(histogram.percentile(1.0) >= histogram.max());
+}
+
+TEST(latency_histogram, small_values_are_exact) {
+    LatencyHistogram histogram;
+    for (uint64_t ns = 0; ns < 32; ns++) {
+        histogram.record(ns);
+    }
+    CHECK(histogram.percentile(0.5) <= 16u);
+}
+
+TEST(latency_histogram, huge_values_land_in_the_last_bucket) {
+    LatencyHistogram histogram;
+    histogram.record(UINT64_MAX / 2);
+    CHECK_EQ(histogram.count(), 1u);
+    CHECK(histogram.percentile(0.5) > 0u);
+}
+
+TEST(latency_histogram, reset) {
+    LatencyHistogram histogram;
+    histogram.record(1000);
+    histogram.reset();
+    CHECK_EQ(histogram.count(), 0u);
+    CHECK_EQ(histogram.max(), 0u);
+    CHECK_EQ(histogram.sum(), 0u);
+}
+
+TEST(latency_tracker, closed_sessions_leave_only_the_aggregate) {
+    LatencyTracker tracker;
+    LatencySet* set = tracker.session("/session/a");
+    uint64_t now = LatencyTracker::now_ns();
+    tracker.dispatched(set, InputEventKind::KeyboardKey, now, now);
+    tracker.remove_session("/session/a");
+    // Pending events of the removed session only count in the aggregate
+    tracker.flushed();
+
+    bool aggregate = false;
+    for (const auto& summary : tracker.summarize()) {
+        CHECK(summary.session.empty());
+        aggregate |= summary.stage == LatencyStage::Total && summary.count == 1;
+    }
+    CHECK(aggregate);
+}
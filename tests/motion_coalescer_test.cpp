@@ -0,0 +1,188 @@
+#include "test.h"
+#include "recording_pointer.h"
+#include "motion_coalescer.h"
+#include "wayland_virtual_pointer.h"
+
+extern "C" {
+#include <wayland-client-protocol.h>
+}
+
+using Type = PointerCall::Type;
+
+// Flush the coalescer and return what it sent
+static std::vector<PointerCall> flush(MotionCoalescer& coalescer, uint32_t time = 1) {
+    static WaylandVirtualPointer pointer;
+    recorded_pointer_calls().clear();
+    coalescer.flush_to(&pointer, time);
+    return recorded_pointer_calls();
+}
+
+static size_t count(const std::vector<PointerCall>& calls, Type type) {
+    size_t n = 0;
+    for (const auto& call : calls) {
+        n += call.type == type ? 1 : 0;
+    }
+    return n;
+}
+
+TEST(motion_coalescer, relative_motion_merges) {
+    MotionCoalescer coalescer;
+    coalescer.add_motion(1.0, 2.0);
+    coalescer.add_motion(3.0, 4.0);
+    CHECK_EQ(coalescer.coalesced_count(), 1u);
+
+    auto calls = flush(coalescer, 42);
+    REQUIRE(calls.size() == 1);
+    CHECK(calls[0].type == Type::Motion);
+    CHECK_EQ(calls[0].time, 42u);
+    CHECK_NEAR(calls[0].values[0], 4.0, 1e-9);
+    CHECK_NEAR(calls[0].values[1], 6.0, 1e-9);
+    CHECK(coalescer.empty());
+}
+
+TEST(motion_coalescer, sub_fixed_motion_carries_over) {
+    // 1/1000 px is below wl_fixed_t's 1/256 resolution; none of it may be lost
+    MotionCoalescer coalescer;
+    double sent = 0.0;
+    size_t requests = 0;
+    for (int i = 0; i < 1000; i++) {
+        coalescer.add_motion(0.001, 0.0);
+        for (const auto& call : flush(coalescer)) {
+            if (call.type == Type::Motion) {
+                sent += call.values[0];
+                requests++;
+            }
+        }
+    }
+    CHECK_NEAR(sent, 1.0, 1.0 / 256);
+    CHECK(requests < 1000);
+}
+
+TEST(motion_coalescer, absolute_supersedes_earlier_relative) {
+    MotionCoalescer coalescer;
+    coalescer.add_motion(5.0, 5.0);
+    coalescer.add_motion_absolute(100, 200, 1000, 2000);
+    coalescer.add_motion(1.0, 0.0);
+
+    auto calls = flush(coalescer);
+    REQUIRE(calls.size() == 2);
+    CHECK(calls[0].type == Type::MotionAbsolute);
+    CHECK_EQ(calls[0].args[0], 100u);
+    CHECK_EQ(calls[0].args[1], 200u);
+    CHECK_EQ(calls[0].args[2], 1000u);
+    CHECK_EQ(calls[0].args[3], 2000u);
+    CHECK(calls[1].type == Type::Motion);
+    CHECK_NEAR(calls[1].values[0], 1.0, 1e-9);
+}
+
+TEST(motion_coalescer, value120_fractions_add_up_to_a_step) {
+    MotionCoalescer coalescer;
+    // Half a notch scrolls half a notch's pixels but no discrete step yet
+    coalescer.add_scroll_discrete(0, 60);
+    auto calls = flush(coalescer);
+    REQUIRE(calls.size() == 2);
+    CHECK(calls[0].type == Type::AxisSource);
+    CHECK_EQ(calls[0].args[0], static_cast<uint32_t>(WL_POINTER_AXIS_SOURCE_WHEEL));
+    CHECK(calls[1].type == Type::Axis);
+    CHECK_EQ(calls[1].args[0], static_cast<uint32_t>(WL_POINTER_AXIS_VERTICAL_SCROLL));
+    CHECK_NEAR(calls[1].values[0], 7.5, 1e-9);
+
+    // The other half completes the notch
+    coalescer.add_scroll_discrete(0, 60);
+    calls = flush(coalescer);
+    REQUIRE(count(calls, Type::AxisDiscrete) == 1);
+    CHECK_EQ(calls[1].steps, 1);
+    CHECK_NEAR(calls[1].values[0], 7.5, 1e-9);
+}
+
+TEST(motion_coalescer, value120_carry_keeps_its_sign) {
+    MotionCoalescer coalescer;
+    coalescer.add_scroll_discrete(-40, 0);
+    flush(coalescer);
+    coalescer.add_scroll_discrete(-80, 0);
+    auto calls = flush(coalescer);
+    REQUIRE(count(calls, Type::AxisDiscrete) == 1);
+    CHECK_EQ(calls[1].args[0], static_cast<uint32_t>(WL_POINTER_AXIS_HORIZONTAL_SCROLL));
+    CHECK_EQ(calls[1].steps, -1);
+}
+
+TEST(motion_coalescer, whole_notches_merge_into_one_request) {
+    MotionCoalescer coalescer;
+    coalescer.add_scroll_discrete(0, 120);
+    coalescer.add_scroll_discrete(0, 240);
+    CHECK_EQ(coalescer.coalesced_count(), 1u);
+    auto calls = flush(coalescer);
+    REQUIRE(calls.size() == 2);
+    CHECK(calls[1].type == Type::AxisDiscrete);
+    CHECK_EQ(calls[1].steps, 3);
+    CHECK_NEAR(calls[1].values[0], 45.0, 1e-9);
+}
+
+TEST(motion_coalescer, stop_drops_the_carry) {
+    MotionCoalescer coalescer;
+    coalescer.add_scroll_discrete(0, 60);
+    coalescer.add_scroll_stop(false, true);
+    CHECK(coalescer.scroll_stop_pending());
+    auto calls = flush(coalescer);
+    REQUIRE(calls.size() == 3);
+    CHECK(calls[2].type == Type::AxisStop);
+    CHECK_EQ(calls[2].args[0], static_cast<uint32_t>(WL_POINTER_AXIS_VERTICAL_SCROLL));
+
+    // A new sequence starts from zero: half a notch is not completed by the old half
+    coalescer.add_scroll_discrete(0, 60);
+    calls = flush(coalescer);
+    CHECK_EQ(count(calls, Type::AxisDiscrete), 0u);
+    CHECK_EQ(count(calls, Type::Axis), 1u);
+}
+
+TEST(motion_coalescer, nothing_sent_when_everything_carries) {
+    static WaylandVirtualPointer pointer;
+    MotionCoalescer coalescer;
+    coalescer.add_motion(0.001, 0.0);
+    coalescer.add_scroll(0.0, 0.001);
+    recorded_pointer_calls().clear();
+    // Callers frame what was sent; a flush that only fed the carry must say so
+    CHECK(!coalescer.flush_to(&pointer, 1));
+    CHECK_EQ(recorded_pointer_calls().size(), 0u);
+    CHECK(coalescer.empty());
+
+    coalescer.add_motion(1.0, 0.0);
+    CHECK(coalescer.flush_to(&pointer, 2));
+}
+
+TEST(motion_coalescer, no_axis_source_without_an_axis_event) {
+    MotionCoalescer coalescer;
+    // Too small for wl_fixed_t: it only goes into the carry
+    coalescer.add_scroll(0.0, 0.001);
+    auto calls = flush(coalescer);
+    CHECK_EQ(calls.size(), 0u);
+}
+
+TEST(motion_coalescer, smooth_scroll_source) {
+    MotionCoalescer coalescer;
+    coalescer.add_scroll(0.0, 10.0);
+    auto calls = flush(coalescer);
+    REQUIRE(calls.size() == 2);
+    CHECK_EQ(calls[0].args[0], static_cast<uint32_t>(WL_POINTER_AXIS_SOURCE_FINGER));
+
+    coalescer.add_scroll(0.0, 10.0, false);
+    calls = flush(coalescer);
+    REQUIRE(calls.size() == 2);
+    CHECK_EQ(calls[0].args[0], static_cast<uint32_t>(WL_POINTER_AXIS_SOURCE_CONTINUOUS));
+}
+
+TEST(motion_coalescer, merge_adds_pending_input) {
+    MotionCoalescer earlier;
+    MotionCoalescer later;
+    earlier.add_motion(1.0, 0.0);
+    later.add_motion(2.0, 0.0);
+    later.add_scroll_discrete(0, 120);
+    earlier.merge(later);
+
+    auto calls = flush(earlier);
+    REQUIRE(calls.size() == 3);
+    CHECK(calls[0].type == Type::Motion);
+    CHECK_NEAR(calls[0].values[0], 3.0, 1e-9);
+    CHECK(calls[2].type == Type::AxisDiscrete);
+    CHECK_EQ(calls[2].steps, 1);
+}
@@ -0,0 +1,97 @@
+#include "test.h"
+#include "outgoing_queue.h"
+
+using EntryType = OutgoingQueue::Entry::Type;
+
+TEST(outgoing_queue, motion_merges_into_the_open_pointer_entry) {
+    OutgoingQueue queue;
+    queue.motion(10).add_motion(1.0, 0.0);
+    queue.motion(20).add_motion(1.0, 0.0);
+    REQUIRE(queue.size() == 1);
+    CHECK(queue.front().type == EntryType::Pointer);
+    // Sent with the time of the newest input merged into it
+    CHECK_EQ(queue.front().time, 20u);
+    CHECK_EQ(queue.front().motion.coalesced_count(), 1u);
+}
+
+TEST(outgoing_queue, barriers_keep_their_order) {
+    OutgoingQueue queue;
+    queue.motion(1).add_motion(1.0, 0.0);
+    queue.push_button(2, 272, 1);
+    // Motion after the button must not jump ahead of it
+    queue.motion(3).add_motion(1.0, 0.0);
+    queue.push_key(4, 30, 1);
+    queue.push_modifiers(1, 0, 0, 0);
+
+    REQUIRE(queue.size() == 5);
+    EntryType expected[] = {EntryType::Pointer, EntryType::Button, EntryType::Pointer,
+                            EntryType::Key, EntryType::Modifiers};
+    for (EntryType type : expected) {
+        REQUIRE(!queue.empty());
+        CHECK(queue.front().type == type);
+        queue.pop();
+    }
+    CHECK(queue.empty());
+}
+
+TEST(outgoing_queue, barrier_arguments) {
+    OutgoingQueue queue;
+    queue.push_button(7, 273, 1);
+    queue.push_key(8, 30, 0);
+    queue.push_modifiers(1, 2, 3, 4);
+
+    CHECK_EQ(queue.front().time, 7u);
+    CHECK_EQ(queue.front().args[0], 273u);
+    CHECK_EQ(queue.front().args[1], 1u);
+    queue.pop();
+    CHECK_EQ(queue.front().time, 8u);
+    CHECK_EQ(queue.front().args[0], 30u);
+    CHECK_EQ(queue.front().args[1], 0u);
+    queue.pop();
+    CHECK_EQ(queue.front().args[0], 1u);
+    CHECK_EQ(queue.front().args[3], 4u);
+}
+
+TEST(outgoing_queue, push_pointer_closes_the_open_entry) {
+    OutgoingQueue queue;
+    queue.motion(1).add_scroll_stop(false, true);
+    // Scroll after a stop goes into an entry of its own
+    queue.push_pointer();
+    queue.motion(2).add_scroll(0.0, 5.0);
+    CHECK_EQ(queue.size(), 2u);
+}
+
+TEST(outgoing_queue, open_motion_never_adds_an_entry) {
+    OutgoingQueue queue;
+    CHECK(queue.open_motion() == nullptr);
+    queue.push_key(1, 30, 1);
+    // Asking after a barrier must not grow the queue towards its limit
+    CHECK(queue.open_motion() == nullptr);
+    CHECK_EQ(queue.size(), 1u);
+
+    queue.motion(2).add_scroll_stop(false, true);
+    REQUIRE(queue.open_motion() != nullptr);
+    CHECK(queue.open_motion()->scroll_stop_pending());
+    CHECK_EQ(queue.size(), 2u);
+}
+
+TEST(outgoing_queue, emptied_queue_starts_a_new_entry) {
+    OutgoingQueue queue;
+    queue.motion(1).add_motion(1.0, 0.0);
+    queue.pop();
+    CHECK(queue.empty());
+    queue.motion(2).add_motion(1.0, 0.0);
+    CHECK_EQ(queue.size(), 1u);
+    CHECK_EQ(queue.front().motion.coalesced_count(), 0u);
+}
+
+TEST(outgoing_queue, depth_grows_with_every_barrier) {
+    // Portal pauses a client once size() passes --max-queued; keys and
+    // buttons are never merged, so each one adds to the depth
+    OutgoingQueue queue;
+    for (uint32_t i = 0; i < 2000; i++) {
+        queue.motion(i).add_motion(1.0, 0.0);
+        queue.push_key(i, 30, i % 2);
+    }
+    CHECK_EQ(queue.size(), 4000u);
+}
@@ -0,0 +1,49 @@
+#include "test.h"
+#include "mock_compositor.h"
+#include "output_layout.h"
+#include "wayland_connection.h"
+#include <cstdlib>
+
+TEST(output_layout, no_outputs_no_position) {
+    OutputLayout layout;
+    uint32_t x = 0, y = 0, x_extent = 0, y_extent = 0;
+    CHECK(!layout.to_absolute(10.0, 10.0, x, y, x_extent, y_extent));
+}
+
+TEST(output_layout, to_absolute_spans_every_output) {
+    // A 1280x1024 monitor left of the origin and a scale 2 4K one at it
+    MockCompositor compositor;
+    compositor.add_output(-1280, 0, 1280, 1024, 1);
+    compositor.add_output(0, 0, 1920, 1080, 2);
+    REQUIRE(compositor.start());
+    setenv("WAYLAND_DISPLAY", compositor.socket_name().c_str(), 1);
+
+    WaylandConnection wayland;
+    REQUIRE(wayland.init());
+    OutputLayout& layout = wayland.get_outputs();
+    REQUIRE(layout.outputs().size() == 2);
+
+    // Logical sizes: the 4K output's mode is divided by its scale
+    OutputLayout::Bounds bounds = layout.bounds();
+    CHECK_EQ(bounds.x, -1280);
+    CHECK_EQ(bounds.y, 0);
+    CHECK_EQ(bounds.width, 3200);
+    CHECK_EQ(bounds.height, 1080);
+    CHECK_EQ(layout.max_refresh(), 60000);
+
+    // Positions are relative to the top-left of the bounds, in 1/256 pixels
+    uint32_t x = 0, y = 0, x_extent = 0, y_extent = 0;
+    REQUIRE(layout.to_absolute(1280.0 + 100.5, 10.25, x, y, x_extent, y_extent));
+    CHECK_EQ(x_extent, 3200u * OutputLayout::ABSOLUTE_SUBPIXEL);
+    CHECK_EQ(y_extent, 1080u * OutputLayout::ABSOLUTE_SUBPIXEL);
+    CHECK_EQ(x, static_cast<uint32_t>(1380.5 * OutputLayout::ABSOLUTE_SUBPIXEL));
+    CHECK_EQ(y, static_cast<uint32_t>(10.25 * OutputLayout::ABSOLUTE_SUBPIXEL));
+
+    // Anything outside is clamped onto the nearest edge, never onto the extent itself
+    REQUIRE(layout.to_absolute(-50.0, 5000.0, x, y, x_extent, y_extent));
+    CHECK_EQ(x, 0u);
+    CHECK_EQ(y, y_extent - 1);
+
+    wayland.cleanup();
+    compositor.stop();
+}
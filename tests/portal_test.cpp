@@ -0,0 +1,251 @@
+// End to end: libei sender -> portal daemon -> MockCompositor, on a private
+// session bus. Needs dbus-daemon and the built portal, but no compositor.
+
+#include "test.h"
+#include "mock_compositor.h"
+#include "portal_harness.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libei.h>
+#include <linux/input-event-codes.h>
+}
+
+using RequestType = MockCompositor::RequestType;
+
+static const char* STATS_INTERFACE = "org.freedesktop.impl.portal.desktop.hypr_remote.Stats";
+
+// A daemon started against its own bus and compositor, with a libei sender
+// connected to one session
+class Daemon {
+public:
+    ~Daemon();
+
+    bool start(const std::string& name);
+
+    void motion() {
+        ei_device_pointer_motion(sender.pointer, 1.0, 0.0);
+        ei_device_frame(sender.pointer, ei_now(sender.ei));
+    }
+    void button(uint32_t button, bool pressed) {
+        ei_device_button_button(sender.pointer, button, pressed);
+        ei_device_frame(sender.pointer, ei_now(sender.ei));
+    }
+    void key(uint32_t key, bool pressed) {
+        ei_device_keyboard_key(sender.keyboard, key, pressed);
+        ei_device_frame(sender.keyboard, ei_now(sender.ei));
+    }
+
+    // Keeps the libei connection serviced until done() or the timeout
+    template <typename Predicate>
+    bool wait_for(Predicate done, double timeout = 5.0) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+        while (!done()) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            sender.pump();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // Requests of the given types the compositor has received so far
+    std::vector<MockCompositor::Request> received(std::initializer_list<RequestType> types) const;
+
+    // A sample without labels from GetMetrics
+    uint64_t metric(const std::string& name);
+    std::map<std::string, uint64_t> queue_stats();
+
+    MockCompositor compositor;
+    Sender sender;
+
+private:
+    pid_t bus_pid = -1;
+    pid_t daemon_pid = -1;
+    std::unique_ptr<sdbus::IConnection> connection;
+    std::unique_ptr<sdbus::IProxy> stats;
+};
+
+Daemon::~Daemon() {
+    sender.cleanup();
+    stats.reset();
+    connection.reset();
+    terminate(daemon_pid);
+    compositor.stop();
+    terminate(bus_pid);
+}
+
+bool Daemon::start(const std::string& name) {
+    std::string bus_address = start_private_bus(bus_pid);
+    if (bus_address.empty() || !compositor.start()) {
+        return false;
+    }
+    setenv("DBUS_SESSION_BUS_ADDRESS", bus_address.c_str(), 1);
+    setenv("WAYLAND_DISPLAY", compositor.socket_name().c_str(), 1);
+    daemon_pid = spawn({PORTAL_BINARY}, false);
+
+    try {
+        connection = sdbus::createSessionBusConnection();
+        stats = sdbus::createProxy(*connection, sdbus::ServiceName{PORTAL_NAME}, sdbus::ObjectPath{PORTAL_PATH});
+        int eis_fd = connect_to_eis(*connection, 10.0, "/org/freedesktop/portal/desktop/session/" + name, name);
+        if (eis_fd < 0 || !sender.connect(eis_fd, 5.0, name.c_str())) {
+            return false;
+        }
+
+        // Device setup flushes too; let it finish before anything is counted
+        uint64_t flushes = metric("hypr_remote_wayland_flushes_total");
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            sender.pump();
+            uint64_t now = metric("hypr_remote_wayland_flushes_total");
+            if (now == flushes) break;
+            flushes = now;
+        }
+    } catch (const sdbus::Error& e) {
+        std::cerr << "D-Bus error: " << e.what() << std::endl;
+        return false;
+    }
+    compositor.clear_requests();
+    return true;
+}
+
+std::vector<MockCompositor::Request> Daemon::received(std::initializer_list<RequestType> types) const {
+    std::vector<MockCompositor::Request> result;
+    for (const auto& request : compositor.requests()) {
+        for (RequestType type : types) {
+            if (request.type == type) {
+                result.push_back(request);
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+uint64_t Daemon::metric(const std::string& name) {
+    std::string text;
+    stats->callMethod("GetMetrics").onInterface(STATS_INTERFACE).storeResultsTo(text);
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind(name + " ", 0) == 0) {
+            return std::stoull(line.substr(name.size() + 1));
+        }
+    }
+    return 0;
+}
+
+std::map<std::string, uint64_t> Daemon::queue_stats() {
+    std::map<std::string, uint64_t> result;
+    stats->callMethod("GetQueueStats").onInterface(STATS_INTERFACE).storeResultsTo(result);
+    return result;
+}
+
+TEST(portal, buttons_and_keys_keep_their_order) {
+    Daemon daemon;
+    REQUIRE(daemon.start("order"));
+
+    // Alternate between the two devices without waiting, so any reordering
+    // between pointer and keyboard requests shows up
+    std::vector<std::pair<RequestType, uint32_t>> expected;
+    const uint32_t keys[] = {KEY_A, KEY_S, KEY_D};
+    for (uint32_t round = 0; round < 60; round++) {
+        uint32_t button = round % 2 ? BTN_RIGHT : BTN_LEFT;
+        uint32_t key = keys[round % 3];
+        for (bool pressed : {true, false}) {
+            daemon.button(button, pressed);
+            daemon.key(key, pressed);
+            expected.push_back({RequestType::PointerButton, button});
+            expected.push_back({RequestType::KeyboardKey, key});
+        }
+    }
+
+    REQUIRE(daemon.wait_for([&]() {
+        return daemon.received({RequestType::PointerButton, RequestType::KeyboardKey}).size() >= expected.size();
+    }));
+
+    auto received = daemon.received({RequestType::PointerButton, RequestType::KeyboardKey});
+    REQUIRE(received.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        CHECK(received[i].type == expected[i].first);
+        CHECK_EQ(received[i].args[0], expected[i].second);
+        // Pressed and released alternate within each device
+        CHECK_EQ(received[i].args[1], static_cast<uint32_t>((i / 2) % 2 == 0 ? 1 : 0));
+    }
+}
+
+TEST(portal, one_flush_per_frame) {
+    Daemon daemon;
+    REQUIRE(daemon.start("flush"));
+
+    uint64_t before = daemon.metric("hypr_remote_wayland_flushes_total");
+    const size_t frames = 30;
+    bool button_down = false;
+    bool key_down = false;
+    for (size_t i = 0; i < frames; i++) {
+        switch (i % 3) {
+            case 0: daemon.motion(); break;
+            case 1: daemon.button(BTN_LEFT, button_down = !button_down); break;
+            case 2: daemon.key(KEY_A, key_down = !key_down); break;
+        }
+        // Wait for each frame, so frames are never merged into one flush
+        REQUIRE(daemon.wait_for([&]() {
+            return daemon.received({RequestType::PointerFrame, RequestType::KeyboardKey}).size() == i + 1;
+        }));
+    }
+
+    CHECK_EQ(daemon.metric("hypr_remote_wayland_flushes_total") - before, static_cast<uint64_t>(frames));
+    CHECK_EQ(daemon.received({RequestType::PointerFrame}).size(), 2 * frames / 3);
+}
+
+TEST(portal, stalled_compositor_queues_and_resumes) {
+    Daemon daemon;
+    REQUIRE(daemon.start("backpressure"));
+
+    // Until the socket to the compositor is full, wl_display_flush() hits
+    // EAGAIN and the daemon starts queueing. Batches stay far below
+    // --max-queued, so the EIS devices are never paused and nothing sent is
+    // held back by libei.
+    daemon.compositor.pause_reading();
+    std::vector<std::pair<uint32_t, uint32_t>> sent;
+    auto send_batch = [&]() {
+        for (int i = 0; i < 64; i++) {
+            uint32_t key = KEY_1 + (sent.size() / 2) % 9;
+            uint32_t pressed = sent.size() % 2 == 0 ? 1 : 0;
+            daemon.key(key, pressed);
+            sent.push_back({key, pressed});
+        }
+        daemon.sender.pump();
+    };
+    while (daemon.queue_stats()["stalls"] == 0 && sent.size() < 200000) {
+        send_batch();
+    }
+    REQUIRE(daemon.queue_stats()["stalls"] > 0);
+
+    // Input arriving while stalled waits in the session's queue
+    send_batch();
+    CHECK(daemon.wait_for([&]() { return daemon.queue_stats()["depth"] > 0; }));
+    CHECK(daemon.received({RequestType::KeyboardKey}).size() < sent.size());
+
+    daemon.compositor.resume_reading();
+    REQUIRE(daemon.wait_for([&]() {
+        return daemon.received({RequestType::KeyboardKey}).size() >= sent.size();
+    }, 10.0));
+
+    auto received = daemon.received({RequestType::KeyboardKey});
+    REQUIRE(received.size() == sent.size());
+    for (size_t i = 0; i < sent.size(); i++) {
+        CHECK_EQ(received[i].args[0], sent[i].first);
+        CHECK_EQ(received[i].args[1], sent[i].second);
+    }
+    CHECK(daemon.wait_for([&]() { return daemon.queue_stats()["depth"] == 0; }));
+    CHECK_EQ(daemon.queue_stats()["dropped"], 0ull);
+}
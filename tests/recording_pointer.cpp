@@ -0,0 +1,78 @@
+#include "recording_pointer.h"
+#include "wayland_virtual_pointer.h"
+
+std::vector<PointerCall>& recorded_pointer_calls() {
+    static std::vector<PointerCall> calls;
+    return calls;
+}
+
+static PointerCall& record(PointerCall::Type type, uint32_t time = 0) {
+    PointerCall& call = recorded_pointer_calls().emplace_back();
+    call.type = type;
+    call.time = time;
+    return call;
+}
+
+WaylandVirtualPointer::WaylandVirtualPointer()
+    : connection(nullptr), virtual_pointer(nullptr) {
+}
+
+WaylandVirtualPointer::~WaylandVirtualPointer() {
+}
+
+bool WaylandVirtualPointer::init(WaylandConnection* conn) {
+    connection = conn;
+    return true;
+}
+
+void WaylandVirtualPointer::cleanup() {
+}
+
+void WaylandVirtualPointer::send_motion(uint32_t time, double dx, double dy) {
+    PointerCall& call = record(PointerCall::Type::Motion, time);
+    call.values[0] = dx;
+    call.values[1] = dy;
+}
+
+void WaylandVirtualPointer::send_motion_absolute(uint32_t time, uint32_t x, uint32_t y,
+                                                 uint32_t x_extent, uint32_t y_extent) {
+    PointerCall& call = record(PointerCall::Type::MotionAbsolute, time);
+    call.args[0] = x;
+    call.args[1] = y;
+    call.args[2] = x_extent;
+    call.args[3] = y_extent;
+}
+
+void WaylandVirtualPointer::send_button(uint32_t time, uint32_t button, uint32_t state) {
+    PointerCall& call = record(PointerCall::Type::Button, time);
+    call.args[0] = button;
+    call.args[1] = state;
+}
+
+void WaylandVirtualPointer::send_axis(uint32_t time, uint32_t axis, double value) {
+    PointerCall& call = record(PointerCall::Type::Axis, time);
+    call.args[0] = axis;
+    call.values[0] = value;
+}
+
+void WaylandVirtualPointer::send_axis_source(uint32_t axis_source) {
+    record(PointerCall::Type::AxisSource).args[0] = axis_source;
+}
+
+void WaylandVirtualPointer::send_axis_discrete(uint32_t time, uint32_t axis, double value, int32_t steps) {
+    PointerCall& call = record(PointerCall::Type::AxisDiscrete, time);
+    call.args[0] = axis;
+    call.values[0] = value;
+    call.steps = steps;
+}
+
+void WaylandVirtualPointer::send_axis_stop(uint32_t time, uint32_t axis) {
+    record(PointerCall::Type::AxisStop, time).args[0] = axis;
+}
+
+void WaylandVirtualPointer::send_frame() {
+    record(PointerCall::Type::Frame);
+}
+
+void WaylandVirtualPointer::flush() {
+}
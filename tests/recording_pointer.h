@@ -0,0 +1,29 @@
+#pragma once
+
+// Link seam for unit tests: recording_pointer.cpp implements
+// WaylandVirtualPointer without a compositor and keeps every request it is
+// asked to send, so code driving a pointer can be checked request by request.
+
+#include <cstdint>
+#include <vector>
+
+struct PointerCall {
+    enum class Type {
+        Motion,
+        MotionAbsolute,
+        Button,
+        Axis,
+        AxisSource,
+        AxisDiscrete,
+        AxisStop,
+        Frame,
+    };
+    Type type;
+    uint32_t time = 0;
+    uint32_t args[4] = {};      // button/state, axis, source, absolute x/y/extents
+    double values[2] = {};      // motion dx/dy, axis value
+    int32_t steps = 0;          // axis_discrete
+};
+
+// Everything sent on any WaylandVirtualPointer since the last clear
+std::vector<PointerCall>& recorded_pointer_calls();
@@ -0,0 +1,89 @@
+#pragma once
+
+// Minimal test harness: no framework to install, every test is a plain
+// function registered by TEST(). Run a test binary with a name prefix to
+// pick suites, e.g. `unit-tests motion_coalescer`; ctest does that per suite.
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace test {
+
+struct Case {
+    std::string name;
+    std::function<void()> run;
+};
+
+inline std::vector<Case>& cases() {
+    static std::vector<Case> registered;
+    return registered;
+}
+
+// Failed checks of the test currently running
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+struct Registration {
+    Registration(const char* name, std::function<void()> run) {
+        cases().push_back({name, std::move(run)});
+    }
+};
+
+inline void fail(const char* file, int line, const std::string& message) {
+    std::cerr << "  " << file << ":" << line << ": " << message << std::endl;
+    failures()++;
+}
+
+// Runs every test whose name starts with one of the prefixes (all without any)
+int run(int argc, char* argv[]);
+
+} // namespace test
+
+#define TEST_CONCAT_(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_(a, b)
+
+// TEST(suite, name) { ... } registers "suite.name"
+#define TEST(suite, name)                                                          \
+    static void suite##_##name();                                                  \
+    static test::Registration TEST_CONCAT(suite##_##name##_registration_, __LINE__)( \
+        #suite "." #name, suite##_##name);                                         \
+    static void suite##_##name()
+
+#define CHECK(condition)                                                           \
+    do {                                                                           \
+        if (!(condition)) test::fail(__FILE__, __LINE__, "CHECK(" #condition ")"); \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                 \
+    do {                                                                           \
+        auto actual_ = (actual);                                                   \
+        auto expected_ = (expected);                                               \
+        if (!(actual_ == expected_)) {                                             \
+            test::fail(__FILE__, __LINE__, std::string(#actual " == " #expected ": got ") + \
+                       std::to_string(actual_) + ", expected " + std::to_string(expected_)); \
+        }                                                                          \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                    \
+    do {                                                                           \
+        double actual_ = (actual);                                                 \
+        double expected_ = (expected);                                             \
+        if (!(std::fabs(actual_ - expected_) <= (tolerance))) {                    \
+            test::fail(__FILE__, __LINE__, std::string(#actual " ~= " #expected ": got ") + \
+                       std::to_string(actual_) + ", expected " + std::to_string(expected_)); \
+        }                                                                          \
+    } while (0)
+
+// Stops the test: later checks would only repeat the failure
+#define REQUIRE(condition)                                                         \
+    do {                                                                           \
+        if (!(condition)) {                                                        \
+            test::fail(__FILE__, __LINE__, "REQUIRE(" #condition ")");             \
+            return;                                                                \
+        }                                                                          \
+    } while (0)
@@ -0,0 +1,39 @@
+#include "test.h"
+#include <exception>
+
+int test::run(int argc, char* argv[]) {
+    int run = 0;
+    int failed = 0;
+    for (const Case& c : cases()) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; i++) {
+            selected |= c.name.rfind(argv[i], 0) == 0;
+        }
+        if (!selected) continue;
+
+        failures() = 0;
+        try {
+            c.run();
+        } catch (const std::exception& e) {
+            fail(__FILE__, __LINE__, std::string("uncaught exception: ") + e.what());
+        }
+        run++;
+        if (failures() > 0) {
+            failed++;
+            std::cout << "FAIL " << c.name << std::endl;
+        } else {
+            std::cout << "ok   " << c.name << std::endl;
+        }
+    }
+
+    if (run == 0) {
+        std::cerr << "No tests matched" << std::endl;
+        return 1;
+    }
+    std::cout << run - failed << "/" << run << " passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    return test::run(argc, argv);
+}